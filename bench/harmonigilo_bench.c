@@ -0,0 +1,611 @@
+/*
+    Copyright (C) 2016 Johannes Mueller <github@johannes-mueller.org>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    version 2 as published by the Free Software Foundation;
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Offline benchmark of the DSP. Drives the plugin through lv2_descriptor()
+ * without a host, sweeping sample rates, block sizes and the number of
+ * enabled voices, and feeds it a synthetic vocal-like signal. Several
+ * instances can be run at once, each on its own thread like a host that
+ * processes its tracks in parallel, they all share the plugin's workers.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lv2/lv2plug.in/ns/lv2core/lv2.h"
+
+#include "src/harmonigilo.h"
+#include "src/fast_math.h"
+
+#define MAX_PORTS (HRM_VOICE_PORTS*MAX_CHAN_NUM + HRM_VOICE_LOAD_0 + 1 + 2*MAX_CHAN_NUM)
+#define MAX_BLOCK 8192
+#define MAX_INSTANCES 64
+#define BENCH_PI 3.14159265358979323846
+
+static const double rates[] = { 44100, 48000, 96000, 192000 };
+static const uint32_t blocks[] = { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192 };
+
+/* voice setups of a typical vocal doubling patch, repeated for the
+ * variants with more voices */
+static const float voice_delay[DEFAULT_CHAN_NUM] = { 12.f, 15.f, 18.f, 21.f, 24.f, 27.f };
+static const float voice_pitch[DEFAULT_CHAN_NUM] = { 17.f, -17.f, 11.f, -11.f, 7.f, -7.f };
+static const float voice_pan[DEFAULT_CHAN_NUM] = { 0.1f, 0.9f, 0.25f, 0.75f, 0.4f, 0.6f };
+// the long delay variant stretches the delays to a slapback of 1.2 to 2.7 s
+#define LONG_DELAY_SCALE 100.f
+
+typedef struct {
+	double rate;
+	double t;
+	double phase;
+	// the breath noise, each synth has its own so the threads don't share rand()
+	uint32_t seed;
+	// three formant resonators
+	double z1[3], z2[3];
+	double b0[3], a1[3], a2[3];
+} VoiceSynth;
+
+static void
+init_voice_synth(VoiceSynth* vs, double rate)
+{
+	static const double formant[3] = { 700.0, 1220.0, 2600.0 };
+	static const double bandwidth[3] = { 130.0, 70.0, 160.0 };
+
+	memset(vs, 0, sizeof(VoiceSynth));
+	vs->rate = rate;
+	for (int f=0; f<3; ++f) {
+		const double r = exp(-BENCH_PI*bandwidth[f]/rate);
+		vs->a1[f] = -2.0*r*cos(2.0*BENCH_PI*formant[f]/rate);
+		vs->a2[f] = r*r;
+		vs->b0[f] = 1.0 - r;
+	}
+	vs->seed = 1;
+}
+
+/* a sawtooth glottal source with vibrato and some breath noise, shaped by
+ * formant filters and chopped into phrases of 1.6s with 0.4s of silence */
+static void
+synthesize_voice(VoiceSynth* vs, float* out, uint32_t n_samples)
+{
+	for (uint32_t i=0; i<n_samples; ++i) {
+		const double phrase_pos = fmod(vs->t, 2.0);
+		double env = 0.0;
+		if (phrase_pos < 1.6) {
+			env = fmin(1.0, fmin(phrase_pos, 1.6-phrase_pos) / 0.03);
+		}
+
+		const double f0 = 220.0 * pow(2.0, (0.3*sin(vs->t*0.7) + 0.025*sin(2.0*BENCH_PI*5.5*vs->t)));
+		vs->phase += f0/vs->rate;
+		if (vs->phase >= 1.0) {
+			vs->phase -= 1.0;
+		}
+		vs->seed = vs->seed * 1664525u + 1013904223u;
+		const double noise = (vs->seed >> 8) / (double)(1u << 23) - 1.0;
+		const double src = (2.0*vs->phase - 1.0) + 0.05*noise;
+
+		double y = 0.0;
+		for (int f=0; f<3; ++f) {
+			const double v = vs->b0[f]*src - vs->a1[f]*vs->z1[f] - vs->a2[f]*vs->z2[f];
+			vs->z2[f] = vs->z1[f];
+			vs->z1[f] = v;
+			y += v;
+		}
+		out[i] = (float) (0.3 * env * y);
+		vs->t += 1.0/vs->rate;
+	}
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+static int
+cmp_double(const void* a, const void* b)
+{
+	const double x = *(const double*)a;
+	const double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+typedef struct {
+	const LV2_Descriptor* desc;
+	LV2_Handle h;
+	uint32_t block;
+	uint32_t n_periods;
+
+	float ctl[MAX_PORTS];
+	float in[MAX_BLOCK], in_r[MAX_BLOCK], out_l[MAX_BLOCK], out_r[MAX_BLOCK];
+	VoiceSynth vs, vs_r;
+
+	double* period_time;
+} Instance;
+
+static const LV2_Descriptor*
+find_variant(uint32_t n_voices, bool stereo, bool long_delay)
+{
+	const LV2_Descriptor* desc;
+	for (uint32_t i=0; (desc = lv2_descriptor(i)); ++i) {
+		if (hrm_variant_voices(desc->URI) == n_voices && hrm_variant_stereo(desc->URI) == stereo
+		    && hrm_variant_long(desc->URI) == long_delay) {
+			return desc;
+		}
+	}
+	return NULL;
+}
+
+static void
+setup_controls(float* ctl, uint32_t variant, bool stereo, bool long_delay, bool unison, uint32_t n_voices, float engine, float live_latency, bool parallel, bool measure)
+{
+	memset(ctl, 0, MAX_PORTS*sizeof(float));
+	for (uint32_t v=0; v<variant; ++v) {
+		float* voice = ctl + HRM_VOICE_PORTS*v;
+		voice[HRM_ENABLED_0] = v < n_voices ? 1.f : 0.f;
+		voice[HRM_DELAY_0] = voice_delay[v % DEFAULT_CHAN_NUM] * (long_delay ? LONG_DELAY_SCALE : 1.f);
+		voice[HRM_PITCH_0] = unison ? 0.f : voice_pitch[v % DEFAULT_CHAN_NUM];
+		voice[HRM_PAN_0] = voice_pan[v % DEFAULT_CHAN_NUM];
+		voice[HRM_GAIN_0] = -6.f;
+	}
+	ctl[hrm_port(variant, HRM_DRY_PAN)] = 0.5f;
+	ctl[hrm_port(variant, HRM_ENABLED)] = 1.f;
+	ctl[hrm_port(variant, HRM_PARALLEL)] = parallel ? 1.f : 0.f;
+	ctl[hrm_port(variant, HRM_ENGINE)] = engine;
+	ctl[hrm_port(variant, HRM_MEASURE_LOAD)] = measure ? 1.f : 0.f;
+	ctl[hrm_port(variant, HRM_PAN_LAW)] = HRM_PAN_CONSTANT_POWER;
+	ctl[hrm_port(variant, HRM_WIDTH)] = 1.f;
+	ctl[hrm_port(variant, HRM_GATE_THRESHOLD)] = -70.f;
+	ctl[hrm_port(variant, HRM_GATE_HOLD)] = 200.f;
+	ctl[hrm_port(variant, HRM_LIVE)] = live_latency >= 0.f ? 1.f : 0.f;
+	ctl[hrm_port(variant, HRM_MAX_LATENCY)] = fmaxf(live_latency, 0.f);
+	if (stereo) {
+		// the voices take left, right and mid in turn
+		for (uint32_t v=0; v<variant; ++v) {
+			ctl[hrm_source_port(variant, v)] = v % HRM_N_SOURCES;
+		}
+	}
+}
+
+static bool
+setup_instance(Instance* inst, uint32_t variant, bool stereo, bool long_delay, bool unison, double rate, uint32_t block, uint32_t n_voices, float engine, float live_latency, bool parallel, bool measure, double seconds)
+{
+	const LV2_Descriptor* desc = find_variant(variant, stereo, long_delay);
+	inst->desc = desc;
+	inst->block = block;
+	inst->n_periods = (uint32_t) ceil(seconds*rate/block);
+	inst->period_time = (double*)malloc(inst->n_periods*sizeof(double));
+	inst->h = desc->instantiate(desc, rate, "", NULL);
+	if (!inst->h || !inst->period_time) {
+		fprintf(stderr, "instantiation failed\n");
+		return false;
+	}
+
+	setup_controls(inst->ctl, variant, stereo, long_delay, unison, n_voices, engine, live_latency, parallel, measure);
+	const uint32_t n_ports = stereo ? hrm_n_ports_stereo(variant) : hrm_n_ports(variant);
+	for (uint32_t p=0; p<n_ports; ++p) {
+		if (p == hrm_port(variant, HRM_INPUT)) {
+			desc->connect_port(inst->h, p, inst->in);
+		} else if (stereo && p == hrm_input_r_port(variant)) {
+			desc->connect_port(inst->h, p, inst->in_r);
+		} else if (p == hrm_port(variant, HRM_OUTPUT_L)) {
+			desc->connect_port(inst->h, p, inst->out_l);
+		} else if (p == hrm_port(variant, HRM_OUTPUT_R)) {
+			desc->connect_port(inst->h, p, inst->out_r);
+		} else {
+			desc->connect_port(inst->h, p, &inst->ctl[p]);
+		}
+	}
+	desc->activate(inst->h);
+
+	init_voice_synth(&inst->vs, rate);
+	// the right one is a double that comes in a bit later
+	init_voice_synth(&inst->vs_r, rate);
+	inst->vs_r.t = -0.5;
+
+	// let ramps settle and the pitchers fill
+	const uint32_t n_warmup = (uint32_t) ceil(0.5*rate/block);
+	for (uint32_t p=0; p<n_warmup; ++p) {
+		synthesize_voice(&inst->vs, inst->in, block);
+		synthesize_voice(&inst->vs_r, inst->in_r, block);
+		desc->run(inst->h, block);
+	}
+	return true;
+}
+
+static void
+teardown_instance(Instance* inst)
+{
+	if (inst->h) {
+		inst->desc->deactivate(inst->h);
+		inst->desc->cleanup(inst->h);
+	}
+	free(inst->period_time);
+}
+
+static void*
+run_instance(void* arg)
+{
+	Instance* inst = (Instance*)arg;
+	for (uint32_t p=0; p<inst->n_periods; ++p) {
+		synthesize_voice(&inst->vs, inst->in, inst->block);
+		synthesize_voice(&inst->vs_r, inst->in_r, inst->block);
+		const double t0 = now();
+		inst->desc->run(inst->h, inst->block);
+		inst->period_time[p] = now() - t0;
+	}
+	return NULL;
+}
+
+static int
+bench(uint32_t variant, bool stereo, bool long_delay, bool unison, double rate, uint32_t block, uint32_t n_voices, float engine, float live_latency, bool parallel, bool measure, double seconds, uint32_t n_instances)
+{
+	Instance* inst = (Instance*)calloc(n_instances, sizeof(Instance));
+	if (!inst) {
+		return 1;
+	}
+	bool ok = true;
+	for (uint32_t i=0; i<n_instances && ok; ++i) {
+		ok = setup_instance(&inst[i], variant, stereo, long_delay, unison, rate, block, n_voices, engine, live_latency, parallel, measure, seconds);
+	}
+
+	const uint32_t n_periods = inst[0].n_periods;
+	double* period_time = (double*)malloc(n_instances*n_periods*sizeof(double));
+	double wall = 0.0;
+	if (ok && period_time) {
+		pthread_t threads[MAX_INSTANCES];
+		const double t0 = now();
+		for (uint32_t i=1; i<n_instances; ++i) {
+			pthread_create(&threads[i], NULL, run_instance, &inst[i]);
+		}
+		run_instance(&inst[0]);
+		for (uint32_t i=1; i<n_instances; ++i) {
+			pthread_join(threads[i], NULL);
+		}
+		wall = now() - t0;
+
+		for (uint32_t i=0; i<n_instances; ++i) {
+			memcpy(period_time + i*n_periods, inst[i].period_time, n_periods*sizeof(double));
+		}
+	}
+
+	for (uint32_t i=0; i<n_instances; ++i) {
+		teardown_instance(&inst[i]);
+	}
+	free(inst);
+	if (!ok || !period_time) {
+		free(period_time);
+		return 1;
+	}
+
+	// the percentiles are over the periods of all instances, the time per
+	// sample over the samples all instances have processed together
+	const uint32_t n_times = n_instances*n_periods;
+	qsort(period_time, n_times, sizeof(double), cmp_double);
+
+	const double n_samples = (double)n_periods * block;
+	const double budget = block / rate;
+	printf("%6.0f %5u %6u %9.1f %8.1f %8.1f %8.1f %8.1f %8.1f %6.1f%%\n",
+	       rate, block, n_voices,
+	       1e9 * wall / (n_samples*n_instances),
+	       n_samples / rate / wall,
+	       1e6 * period_time[n_times/2],
+	       1e6 * period_time[(uint32_t)(n_times*0.99)],
+	       1e6 * period_time[(uint32_t)(n_times*0.999)],
+	       1e6 * period_time[n_times-1],
+	       100.0 * period_time[n_times-1] / budget);
+
+	free(period_time);
+	return 0;
+}
+
+/* db_to_gain() and cents_to_ratio() scale their argument for fast_exp2f()
+ * in float, its rounding adds an error that grows with the exponent x */
+static double
+scaled_exp2_bound(double x)
+{
+	return FAST_EXP2_MAX_ERROR + 0.7 * FLT_EPSILON * fabs(x);
+}
+
+/* the largest error of the fast math against libm over the whole range,
+ * and how long it takes per value compared to libm */
+static int
+check_fast_math(void)
+{
+	static float x[MAX_BLOCK], y[MAX_BLOCK];
+	double err_exp2 = 0.0, err_block = 0.0, err_log2 = 0.0, err_db = 0.0, err_cents = 0.0;
+	bool scaled_ok = true;
+
+	for (uint32_t b=0; b<(253u*10000u)/MAX_BLOCK+1; ++b) {
+		for (uint32_t i=0; i<MAX_BLOCK; ++i) {
+			x[i] = fminf(-126.f + (b*MAX_BLOCK + i) * 1e-4f, 127.f);
+		}
+		exp2_block(x, y, 1.f, MAX_BLOCK);
+		for (uint32_t i=0; i<MAX_BLOCK; ++i) {
+			const double ref = exp2(x[i]);
+			err_exp2 = fmax(err_exp2, fabs(fast_exp2f(x[i]) / ref - 1.0));
+			err_block = fmax(err_block, fabs(y[i] / ref - 1.0));
+		}
+	}
+	// every 7th float from the smallest normal on
+	for (uint32_t bits=0x00800000; bits<0x7f800000; bits+=7) {
+		float v;
+		memcpy(&v, &bits, sizeof(float));
+		const double ref = log2(v);
+		err_log2 = fmax(err_log2, fabs(fast_log2f(v) - ref) / fmax(1.0, fabs(ref)));
+	}
+	for (float db=-120.f; db<=24.f; db+=1e-3f) {
+		const double err = fabs(db_to_gain(db) / pow(10.0, db/20.0) - 1.0);
+		scaled_ok = scaled_ok && err < scaled_exp2_bound(db * FAST_LOG2_10/20.0);
+		err_db = fmax(err_db, err);
+	}
+	for (float cents=-2400.f; cents<=2400.f; cents+=1e-2f) {
+		const double err = fabs(cents_to_ratio(cents) / pow(2.0, cents/1200.0) - 1.0);
+		scaled_ok = scaled_ok && err < scaled_exp2_bound(cents/1200.0);
+		err_cents = fmax(err_cents, err);
+	}
+
+	for (uint32_t i=0; i<MAX_BLOCK; ++i) {
+		x[i] = -60.f + 66.f * i / MAX_BLOCK;
+	}
+	const uint32_t n_runs = 1000;
+	double t0 = now();
+	for (uint32_t r=0; r<n_runs; ++r) {
+		for (uint32_t i=0; i<MAX_BLOCK; ++i) {
+			y[i] = (float) exp(x[i]/20.f*log(10.f));
+		}
+		x[r % MAX_BLOCK] += y[r % MAX_BLOCK] * 1e-30f;
+	}
+	const double t_libm = now() - t0;
+	t0 = now();
+	for (uint32_t r=0; r<n_runs; ++r) {
+		db_to_gain_block(x, y, MAX_BLOCK);
+		x[r % MAX_BLOCK] += y[r % MAX_BLOCK] * 1e-30f;
+	}
+	const double t_block = now() - t0;
+
+	const bool ok = err_exp2 < FAST_EXP2_MAX_ERROR && err_block < FAST_EXP2_MAX_ERROR
+		&& err_log2 < FAST_LOG2_MAX_ERROR && scaled_ok;
+	printf("# fast math, largest error against libm\n"
+	       "fast_exp2f       %.3g (relative, bound %.3g)\n"
+	       "exp2_block       %.3g (relative, bound %.3g)\n"
+	       "fast_log2f       %.3g (absolute, relative beyond 1/2 to 2, bound %.3g)\n"
+	       "db_to_gain       %.3g (relative, -120 to 24 dB, bound %.3g at -120 dB)\n"
+	       "cents_to_ratio   %.3g (relative, -2400 to 2400 cents, bound %.3g at 2400 cents)\n"
+	       "db_to_gain_block %.2f ns/value, libm %.2f ns/value\n"
+	       "%s\n",
+	       err_exp2, FAST_EXP2_MAX_ERROR, err_block, FAST_EXP2_MAX_ERROR, err_log2, FAST_LOG2_MAX_ERROR,
+	       err_db, scaled_exp2_bound(-120.0 * FAST_LOG2_10/20.0), err_cents, scaled_exp2_bound(2.0),
+	       1e9 * t_block / ((double)n_runs*MAX_BLOCK), 1e9 * t_libm / ((double)n_runs*MAX_BLOCK),
+	       ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+/* a click into each source of the stereo variant has to come out of a
+ * voice in the dead zone that takes the source, once and at the voice's
+ * delay, for all engines. The direct voices read the histories without
+ * the shifter, mid included, that nothing else reads from. */
+static int
+check_sources(void)
+{
+	static const char* source_name[HRM_N_SOURCES] = { "left", "right", "mid" };
+	const double rate = 48000.0;
+	const uint32_t block = 256;
+	const uint32_t variant = DEFAULT_CHAN_NUM;
+	bool ok = true;
+
+	printf("# a click into each source through a voice in the dead zone\n");
+	printf("# engine source   expected    found     peak\n");
+	for (uint32_t e=HRM_ENGINE_RUBBERBAND; e<=HRM_ENGINE_VOCODER; ++e) {
+		for (uint32_t src=0; src<HRM_N_SOURCES; ++src) {
+			Instance* inst = (Instance*)calloc(1, sizeof(Instance));
+			if (!inst || !setup_instance(inst, variant, true, false, true, rate, block, variant, e, -1.f, false, false, 1.0)) {
+				if (inst) {
+					teardown_instance(inst);
+				}
+				free(inst);
+				return 1;
+			}
+			// only the first voice, fed by the source, and no dry signal
+			for (uint32_t v=1; v<variant; ++v) {
+				inst->ctl[HRM_VOICE_PORTS*v + HRM_ENABLED_0] = 0.f;
+			}
+			inst->ctl[HRM_PAN_0] = 0.5f;
+			inst->ctl[HRM_GAIN_0] = 0.f;
+			inst->ctl[hrm_source_port(variant, 0)] = src;
+			inst->ctl[hrm_port(variant, HRM_DRY_MUTE)] = 1.f;
+			inst->ctl[hrm_port(variant, HRM_GATE_THRESHOLD)] = -120.f;
+			inst->ctl[hrm_port(variant, HRM_DEAD_ZONE)] = 5.f;
+
+			// one second of silence for the old signal to leave the voice
+			memset(inst->in, 0, sizeof(inst->in));
+			memset(inst->in_r, 0, sizeof(inst->in_r));
+			const uint32_t n_silent = (uint32_t)(rate/block);
+			for (uint32_t p=0; p<n_silent; ++p) {
+				inst->desc->run(inst->h, block);
+			}
+
+			const uint32_t click = 100;
+			const uint32_t expected = click + (uint32_t)lrintf(inst->ctl[HRM_DELAY_0]*rate/1000.f)
+				+ (uint32_t)lrintf(inst->ctl[hrm_port(variant, HRM_LATENCY)]);
+			uint32_t found = 0;
+			float peak = 0.f;
+			for (uint32_t p=0; p<n_silent; ++p) {
+				if (p == 0) {
+					inst->in[click] = src != HRM_SOURCE_RIGHT ? 1.f : 0.f;
+					inst->in_r[click] = src != HRM_SOURCE_LEFT ? 1.f : 0.f;
+				}
+				inst->desc->run(inst->h, block);
+				inst->in[click] = inst->in_r[click] = 0.f;
+				for (uint32_t i=0; i<block; ++i) {
+					const float y = fabsf(inst->out_l[i]) + fabsf(inst->out_r[i]);
+					if (y > peak) {
+						peak = y;
+						found = p*block + i;
+					}
+				}
+			}
+			teardown_instance(inst);
+			free(inst);
+
+			// centered with constant power, 1/sqrt(2) on each side
+			const bool good = found == expected && fabsf(peak - sqrtf(2.f)) < 0.01f;
+			ok = ok && good;
+			printf("%8u %-6s %9u %8u %8.4f %s\n", e, source_name[src], expected, found, peak, good ? "ok" : "FAILED");
+		}
+	}
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+static void
+usage(const char* name)
+{
+	printf("usage: %s [-n variant] [-s] [-d] [-u] [-r rate] [-b block size] [-v voices] [-e engine] [-l ms] [-p] [-i instances] [-m] [-t seconds] [-a] [-c]\n"
+	       "  -n  the variant of the plugin with this many voices, default %d\n"
+	       "  -s  the stereo input variant, its voices take left, right and mid in turn\n"
+	       "  -d  the long delay variant, its voices delayed by 1.2 to 2.7 s\n"
+	       "  -u  a doubler patch, the voices are delayed but not pitch shifted\n"
+	       "  -r  only this sample rate, default all of 44100 48000 96000 192000\n"
+	       "  -b  only this block size, default 16 to 8192\n"
+	       "  -v  only this number of enabled voices, default all of the variant\n"
+	       "  -e  pitch shift engine 0: RubberBand, 1: delay line, 2: phase vocoder\n"
+	       "  -l  live mode with this maximum latency in ms, -e is the preferred engine\n"
+	       "  -p  process the voices in parallel\n"
+	       "  -i  run this many instances at once, each on its own thread, default 1\n"
+	       "  -m  switch on the DSP load measurement of the plugin\n"
+	       "  -t  seconds of audio per measurement, default 2\n"
+	       "  -a  check the error of the fast math against libm and time it instead\n"
+	       "  -c  check that a click into each stereo source comes out of a voice in the\n"
+	       "      dead zone at its delay instead\n",
+	       name, DEFAULT_CHAN_NUM);
+}
+
+int
+main(int argc, char** argv)
+{
+	uint32_t variant = DEFAULT_CHAN_NUM;
+	bool stereo = false;
+	bool long_delay = false;
+	bool unison = false;
+	double only_rate = 0.0;
+	uint32_t only_block = 0;
+	uint32_t only_voices = 0;
+	float engine = HRM_ENGINE_RUBBERBAND;
+	float live_latency = -1.f;
+	bool parallel = false;
+	uint32_t n_instances = 1;
+	bool measure = false;
+	double seconds = 2.0;
+
+	int c;
+	while ((c = getopt(argc, argv, "n:sdur:b:v:e:l:pi:mt:ach")) != -1) {
+		switch (c) {
+		case 'n':
+			variant = atoi(optarg);
+			break;
+		case 's':
+			stereo = true;
+			break;
+		case 'd':
+			long_delay = true;
+			break;
+		case 'u':
+			unison = true;
+			break;
+		case 'r':
+			only_rate = atof(optarg);
+			break;
+		case 'b':
+			only_block = atoi(optarg);
+			break;
+		case 'v':
+			only_voices = atoi(optarg);
+			break;
+		case 'e':
+			engine = atof(optarg);
+			break;
+		case 'l':
+			live_latency = atof(optarg);
+			break;
+		case 'p':
+			parallel = true;
+			break;
+		case 'i':
+			n_instances = atoi(optarg);
+			break;
+		case 'm':
+			measure = true;
+			break;
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 'a':
+			return check_fast_math();
+		case 'c':
+			return check_sources();
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+
+	if (!find_variant(variant, stereo, long_delay) || only_block > MAX_BLOCK || only_voices > variant
+	    || n_instances < 1 || n_instances > MAX_INSTANCES) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	printf("# %u voices %s%svariant%s, engine %.0f%s, %s processing%s, %u instance%s, %.1fs per measurement\n",
+	       variant, stereo ? "stereo " : "", long_delay ? "long delay " : "", unison ? " unison" : "", engine, live_latency >= 0.f ? " live" : "",
+	       parallel ? "parallel" : "serial", measure ? ", load measured" : "",
+	       n_instances, n_instances > 1 ? "s" : "", seconds);
+	printf("#  rate block voices ns/sample rt-factor  p50[us]  p99[us] p999[us]  max[us] max/budget\n");
+
+	for (uint32_t r=0; r<sizeof(rates)/sizeof(rates[0]); ++r) {
+		const double rate = only_rate > 0.0 ? only_rate : rates[r];
+		for (uint32_t b=0; b<sizeof(blocks)/sizeof(blocks[0]); ++b) {
+			const uint32_t block = only_block > 0 ? only_block : blocks[b];
+			for (uint32_t v=1; v<=variant; ++v) {
+				const uint32_t n_voices = only_voices > 0 ? only_voices : v;
+				if (bench(variant, stereo, long_delay, unison, rate, block, n_voices, engine, live_latency, parallel, measure, seconds, n_instances)) {
+					return 1;
+				}
+				if (only_voices > 0) {
+					break;
+				}
+			}
+			if (only_block > 0) {
+				break;
+			}
+		}
+		if (only_rate > 0.0) {
+			break;
+		}
+	}
+
+	return 0;
+}
@@ -21,6 +21,7 @@
 
 #include "lv2/lv2plug.in/ns/extensions/ui/ui.h"
 #include "src/harmonigilo.h"
+#include "src/fast_math.h"
 
 #define ROUTE_WIDTH  80.0
 #define STEP_HEIGHT 50.0
@@ -36,17 +37,21 @@ typedef struct {
 	LV2UI_Write_Function write;
 	LV2UI_Controller controller;
 
+	uint32_t n_voices;
+	float max_delay;
+
 	RobWidget* hbox;
 	RobWidget* ctable;
 
-	RobTkCBtn* voice_enabled[CHAN_NUM];
-	RobTkDial* pitch[CHAN_NUM];
-	RobTkDial* delay[CHAN_NUM];
-	RobTkDial* pan[CHAN_NUM];
-	RobTkScale* gain[CHAN_NUM];
-	RobWidget* sm_box[CHAN_NUM];
-	RobTkCBtn* mute[CHAN_NUM];
-	RobTkCBtn* solo[CHAN_NUM];
+	RobTkCBtn* voice_enabled[MAX_CHAN_NUM];
+	RobTkDial* pitch[MAX_CHAN_NUM];
+	RobTkDial* delay[MAX_CHAN_NUM];
+	RobTkDial* pan[MAX_CHAN_NUM];
+	RobTkScale* gain[MAX_CHAN_NUM];
+	RobWidget* sm_box[MAX_CHAN_NUM];
+	RobTkCBtn* mute[MAX_CHAN_NUM];
+	RobTkCBtn* solo[MAX_CHAN_NUM];
+	RobTkLbl* load[MAX_CHAN_NUM];
 
 	RobTkLbl* lbl_dry;
 
@@ -61,6 +66,7 @@ typedef struct {
 	RobTkLbl* lbl_delay;
 	RobTkLbl* lbl_pan;
 	RobTkLbl* lbl_gain;
+	RobTkLbl* lbl_load;
 
 	RobWidget* master_box;
 	RobTkDial* master_dry_wet;
@@ -71,13 +77,18 @@ typedef struct {
 	RobTkLbl* lbl_master_dry_wet;
 	RobTkLbl* lbl_master_gain;
 
+	RobTkCBtn* measure_load;
+	RobTkLbl* lbl_dsp_load;
+	RobTkLbl* lbl_latency;
+	float latency[3];
+
 	RobTkDarea* left_darea;
 	RobTkDarea* right_darea;
 
-	cairo_surface_t* bg_pitch[CHAN_NUM];
-	cairo_surface_t* bg_delay[CHAN_NUM];
-	cairo_surface_t* bg_pan[CHAN_NUM];
-	cairo_surface_t* bg_gain[CHAN_NUM];
+	cairo_surface_t* bg_pitch[MAX_CHAN_NUM];
+	cairo_surface_t* bg_delay[MAX_CHAN_NUM];
+	cairo_surface_t* bg_pan[MAX_CHAN_NUM];
+	cairo_surface_t* bg_gain[MAX_CHAN_NUM];
 
 	cairo_surface_t* bg_dry_pan;
 	cairo_surface_t* bg_master_gain;
@@ -300,7 +311,7 @@ static void panner_width_faceplate(cairo_surface_t* s)
 
 static void create_faceplate(HarmonigiloUI* ui)
 {
-	for (uint32_t i = 0; i < CHAN_NUM; ++i) {
+	for (uint32_t i = 0; i < ui->n_voices; ++i) {
 
 	}
 
@@ -460,12 +471,12 @@ draw_route_middle(HarmonigiloUI* ui)
 
 static inline float
 from_dB(float gdb) {
-	return (exp(gdb/20.f*log(10.f)));
+	return db_to_gain(gdb);
 }
 
 static inline float
 to_dB(float g) {
-	return (20.f*log10(g));
+	return gain_to_db(g);
 }
 
 static float db_limits(float val)
@@ -479,15 +490,29 @@ static float db_limits(float val)
 	return val;
 }
 
+/* the level of signals of the gains db summed up by power */
+static float get_power_sum_db(const float* db, uint32_t n)
+{
+	float gain[MAX_CHAN_NUM+1];
+	db_to_gain_block(db, gain, n);
+	float sum = 0.f;
+	for (uint32_t i=0; i<n; ++i) {
+		sum += gain[i]*gain[i];
+	}
+	// to_dB() is for gains, a power has half of that
+	return 0.5f * to_dB(sum);
+}
+
 static float get_voice_sum_db(const HarmonigiloUI* ui)
 {
-	float sum_db = 0.f;
-	for (uint32_t i=0; i<CHAN_NUM; ++i) {
+	float db[MAX_CHAN_NUM];
+	uint32_t n = 0;
+	for (uint32_t i=0; i<ui->n_voices; ++i) {
 		if (robtk_cbtn_get_active(ui->voice_enabled[i])) {
-			sum_db += pow(10.f, robtk_scale_get_value(ui->gain[i])/10.f);
+			db[n++] = robtk_scale_get_value(ui->gain[i]);
 		}
 	}
-	return 10.f * log10(sum_db);
+	return get_power_sum_db(db, n);
 }
 
 static void adjust_master_gain(HarmonigiloUI* ui)
@@ -496,14 +521,16 @@ static void adjust_master_gain(HarmonigiloUI* ui)
 		return;
 	}
 
-	float sum_gain = pow(10.f, robtk_scale_get_value(ui->dry_gain)/10.f);
-	for (uint32_t i=0; i<CHAN_NUM; ++i) {
+	float db[MAX_CHAN_NUM+1];
+	uint32_t n = 0;
+	db[n++] = robtk_scale_get_value(ui->dry_gain);
+	for (uint32_t i=0; i<ui->n_voices; ++i) {
 		if (robtk_cbtn_get_active(ui->voice_enabled[i])) {
-			sum_gain += pow(10.f, robtk_scale_get_value(ui->gain[i])/10.f);
+			db[n++] = robtk_scale_get_value(ui->gain[i]);
 		}
 	}
 
-	sum_gain = 10.f * log10(sum_gain);
+	const float sum_gain = get_power_sum_db(db, n);
 
 	bool tmp = ui->disable_signals;
 	ui->disable_signals = true;
@@ -528,7 +555,7 @@ static void adjust_master_dry_wet(HarmonigiloUI* ui)
 static bool cb_set_voice_enabled(RobWidget* handle, void* data)
 {
 	HarmonigiloUI* ui = (HarmonigiloUI*) data;
-	for (uint32_t i=0; i<CHAN_NUM; ++i) {
+	for (uint32_t i=0; i<ui->n_voices; ++i) {
 		const bool enabled = robtk_cbtn_get_active(ui->voice_enabled[i]);
 		const float val = enabled ? 1.f : 0.f;
 		robtk_dial_set_sensitive(ui->pitch[i], enabled);
@@ -538,7 +565,7 @@ static bool cb_set_voice_enabled(RobWidget* handle, void* data)
 		robtk_cbtn_set_sensitive(ui->mute[i], enabled);
 		robtk_cbtn_set_sensitive(ui->solo[i], enabled);
 		if (!ui->disable_signals) {
-			ui->write(ui->controller, HRM_ENABLED_0+(7*i), sizeof(float), 0, (const void*) &val);
+			ui->write(ui->controller, HRM_ENABLED_0+(HRM_VOICE_PORTS*i), sizeof(float), 0, (const void*) &val);
 		}
 	}
 
@@ -556,9 +583,9 @@ static bool cb_set_pitch(RobWidget* handle, void* data)
 	if (ui->disable_signals) {
 		return true;
 	}
-	for (uint32_t i=0; i<CHAN_NUM; ++i) {
+	for (uint32_t i=0; i<ui->n_voices; ++i) {
 		const float val = robtk_dial_get_value(ui->pitch[i]);
-		ui->write(ui->controller, HRM_PITCH_0+(7*i), sizeof(float), 0, (const void*) &val);
+		ui->write(ui->controller, HRM_PITCH_0+(HRM_VOICE_PORTS*i), sizeof(float), 0, (const void*) &val);
 	}
 	return true;
 }
@@ -569,9 +596,9 @@ static bool cb_set_delay(RobWidget* handle, void* data)
 	if (ui->disable_signals) {
 		return true;
 	}
-	for (uint32_t i=0; i<CHAN_NUM; ++i) {
+	for (uint32_t i=0; i<ui->n_voices; ++i) {
 		const float val = robtk_dial_get_value(ui->delay[i]);
-		ui->write(ui->controller, HRM_DELAY_0+(7*i), sizeof(float), 0, (const void*) &val);
+		ui->write(ui->controller, HRM_DELAY_0+(HRM_VOICE_PORTS*i), sizeof(float), 0, (const void*) &val);
 	}
 	return true;
 }
@@ -582,9 +609,9 @@ static bool cb_set_pan(RobWidget* handle, void* data)
 	if (ui->disable_signals) {
 		return true;
 	}
-	for (uint32_t i=0; i<CHAN_NUM; ++i) {
+	for (uint32_t i=0; i<ui->n_voices; ++i) {
 		const float val = robtk_dial_get_value(ui->pan[i]);
-		ui->write(ui->controller, HRM_PAN_0+(7*i), sizeof(float), 0, (const void*) &val);
+		ui->write(ui->controller, HRM_PAN_0+(HRM_VOICE_PORTS*i), sizeof(float), 0, (const void*) &val);
 	}
 	return true;
 }
@@ -597,9 +624,9 @@ static bool cb_set_gain(RobWidget* handle, void* data)
 	}
 	ui->master_dry_wet_active = false;
 
-	for (uint32_t i=0; i<CHAN_NUM; ++i) {
+	for (uint32_t i=0; i<ui->n_voices; ++i) {
 		const float val = robtk_scale_get_value(ui->gain[i]);
-		ui->write(ui->controller, HRM_GAIN_0+(7*i), sizeof(float), 0, (const void*) &val);
+		ui->write(ui->controller, HRM_GAIN_0+(HRM_VOICE_PORTS*i), sizeof(float), 0, (const void*) &val);
 	}
 	adjust_master_gain(ui);
 	adjust_master_dry_wet(ui);
@@ -612,9 +639,9 @@ static bool cb_set_mute(RobWidget* handle, void* data)
 	if (ui->disable_signals) {
 		return true;
 	}
-	for (uint32_t i=0; i<CHAN_NUM; ++i) {
+	for (uint32_t i=0; i<ui->n_voices; ++i) {
 		const float val = robtk_cbtn_get_active(ui->mute[i]) ? 1.f : 0.f;
-		ui->write(ui->controller, HRM_MUTE_0+(7*i), sizeof(float), 0, (const void*) &val);
+		ui->write(ui->controller, HRM_MUTE_0+(HRM_VOICE_PORTS*i), sizeof(float), 0, (const void*) &val);
 	}
 	return true;
 }
@@ -625,9 +652,9 @@ static bool cb_set_solo(RobWidget* handle, void* data)
 	if (ui->disable_signals) {
 		return true;
 	}
-	for (uint32_t i=0; i<CHAN_NUM; ++i) {
+	for (uint32_t i=0; i<ui->n_voices; ++i) {
 		const float val = robtk_cbtn_get_active(ui->solo[i]) ? 1.f : 0.f;
-		ui->write(ui->controller, HRM_SOLO_0+(7*i), sizeof(float), 0, (const void*) &val);
+		ui->write(ui->controller, HRM_SOLO_0+(HRM_VOICE_PORTS*i), sizeof(float), 0, (const void*) &val);
 	}
 	return true;
 }
@@ -639,7 +666,7 @@ static bool cb_set_dry_pan(RobWidget* handle, void* data)
 		return true;
 	}
 	const float val = robtk_dial_get_value(ui->dry_pan);
-	ui->write(ui->controller, HRM_DRY_PAN, sizeof(float), 0, (const void*) &val);
+	ui->write(ui->controller, hrm_port(ui->n_voices, HRM_DRY_PAN), sizeof(float), 0, (const void*) &val);
 
 	return true;
 }
@@ -653,7 +680,7 @@ static bool cb_set_dry_gain(RobWidget* handle, void* data)
 	ui->master_dry_wet_active = false;
 
 	const float val = robtk_scale_get_value(ui->dry_gain);
-	ui->write(ui->controller, HRM_DRY_GAIN, sizeof(float), 0, (const void*) &val);
+	ui->write(ui->controller, hrm_port(ui->n_voices, HRM_DRY_GAIN), sizeof(float), 0, (const void*) &val);
 
 	adjust_master_gain(ui);
 	adjust_master_dry_wet(ui);
@@ -668,7 +695,7 @@ static bool cb_set_dry_mute(RobWidget* handle, void* data)
 		return true;
 	}
 	const float val = robtk_cbtn_get_active(ui->dry_mute) ? 1.f : 0.f;
-	ui->write(ui->controller, HRM_DRY_MUTE, sizeof(float), 0, (const void*) &val);
+	ui->write(ui->controller, hrm_port(ui->n_voices, HRM_DRY_MUTE), sizeof(float), 0, (const void*) &val);
 
 	return true;
 }
@@ -681,11 +708,40 @@ static bool cb_set_dry_solo(RobWidget* handle, void* data)
 		return true;
 	}
 	const float val = robtk_cbtn_get_active(ui->dry_solo) ? 1.f : 0.f;
-	ui->write(ui->controller, HRM_DRY_SOLO, sizeof(float), 0, (const void*) &val);
+	ui->write(ui->controller, hrm_port(ui->n_voices, HRM_DRY_SOLO), sizeof(float), 0, (const void*) &val);
+
+	return true;
+}
+
+static bool cb_set_measure_load(RobWidget* handle, void* data)
+{
+	HarmonigiloUI* ui = (HarmonigiloUI*) data;
+	if (ui->disable_signals) {
+		return true;
+	}
+	const float val = robtk_cbtn_get_active(ui->measure_load) ? 1.f : 0.f;
+	ui->write(ui->controller, hrm_port(ui->n_voices, HRM_MEASURE_LOAD), sizeof(float), 0, (const void*) &val);
 
 	return true;
 }
 
+static void show_load(RobTkLbl* lbl, float load)
+{
+	char txt[16];
+	snprintf(txt, sizeof(txt), "%.1f%%", load);
+	robtk_lbl_set_text(lbl, txt);
+}
+
+/* the reported latency and what the pitch shifters need, of which the
+ * voice delays hide a part */
+static void show_latency(HarmonigiloUI* ui)
+{
+	char txt[64];
+	snprintf(txt, sizeof(txt), "Latency %.0f\nshifter %.0f - hidden %.0f",
+		 ui->latency[0], ui->latency[1], ui->latency[2]);
+	robtk_lbl_set_text(ui->lbl_latency, txt);
+}
+
 static bool cb_set_master_gain(RobWidget* handle, void* data)
 {
 	HarmonigiloUI* ui = (HarmonigiloUI*) data;
@@ -698,19 +754,19 @@ static bool cb_set_master_gain(RobWidget* handle, void* data)
 
 	ui->disable_signals = true;
 
-	for (uint32_t i=0; i<CHAN_NUM; ++i) {
+	for (uint32_t i=0; i<ui->n_voices; ++i) {
 		if (!robtk_cbtn_get_active(ui->voice_enabled[i])) {
 			continue;
 		}
 		const float new_val = db_limits(robtk_scale_get_value(ui->gain[i]) - db_diff);
 		robtk_scale_set_value(ui->gain[i], new_val);
-		ui->write(ui->controller, HRM_GAIN_0+(7*i), sizeof(float), 0, (const void*) &new_val);
+		ui->write(ui->controller, HRM_GAIN_0+(HRM_VOICE_PORTS*i), sizeof(float), 0, (const void*) &new_val);
 
 	}
 
 	const float new_val = db_limits(robtk_scale_get_value(ui->dry_gain) - db_diff);
 	robtk_scale_set_value(ui->dry_gain, new_val);
-	ui->write(ui->controller, HRM_DRY_GAIN, sizeof(float), 0, (const void*) &new_val);
+	ui->write(ui->controller, hrm_port(ui->n_voices, HRM_DRY_GAIN), sizeof(float), 0, (const void*) &new_val);
 
 	ui->disable_signals = false;
 	return true;
@@ -736,15 +792,15 @@ static bool cb_set_master_dry_wet(RobWidget* handle, void* data)
 	ui->disable_signals = true;
 
 	robtk_scale_set_value(ui->dry_gain, dry_db);
-	ui->write(ui->controller, HRM_DRY_GAIN, sizeof(float), 0, (const void*) &dry_db);
+	ui->write(ui->controller, hrm_port(ui->n_voices, HRM_DRY_GAIN), sizeof(float), 0, (const void*) &dry_db);
 
-	for (uint32_t i=0; i<CHAN_NUM; ++i) {
+	for (uint32_t i=0; i<ui->n_voices; ++i) {
 		if (!robtk_cbtn_get_active(ui->voice_enabled[i])) {
 			continue;
 		}
 		const float val = db_limits(robtk_scale_get_value(ui->gain[i]) - db_diff);
 		robtk_scale_set_value(ui->gain[i], val);
-		ui->write(ui->controller, HRM_GAIN_0+(7*i), sizeof(float), 0, (const void*) &val);
+		ui->write(ui->controller, HRM_GAIN_0+(HRM_VOICE_PORTS*i), sizeof(float), 0, (const void*) &val);
 	}
 
 	ui->disable_signals = false;
@@ -773,10 +829,13 @@ static RobWidget* setup_toplevel(HarmonigiloUI* ui)
 	ui->faceplate_font = pango_font_description_from_string("Mono 8px");
 
 	create_faceplate(ui);
-	ui->ctable = rob_table_new(/*rows*/ 8, /*cols*/ CHAN_NUM+2, FALSE);
+	ui->ctable = rob_table_new(/*rows*/ 8, /*cols*/ ui->n_voices+2, FALSE);
 	ui->ctable->expose_event = box_expose_event;
 
-	for (uint32_t i=0; i<CHAN_NUM; ++i) {
+	char delay_max[16];
+	snprintf(delay_max, 16, "%.0f", ui->max_delay);
+
+	for (uint32_t i=0; i<ui->n_voices; ++i) {
 		char txt[16];
 		sprintf(txt, "Voice %d", i+1);
 		ui->voice_enabled[i] = robtk_cbtn_new(txt, GBT_LED_LEFT, false);
@@ -793,13 +852,13 @@ static RobWidget* setup_toplevel(HarmonigiloUI* ui)
 		robtk_dial_set_surface(ui->pitch[i], ui->bg_pitch[i]);
 		rob_table_attach(ui->ctable, robtk_dial_widget(ui->pitch[i]), i+1,i+2, 1, 2, 0,0,RTK_EXPAND,RTK_SHRINK);
 
-		ui->delay[i] = make_sized_robtk_dial(0.0, 50.0, 1.0);
+		ui->delay[i] = make_sized_robtk_dial(0.0, ui->max_delay, ui->max_delay / 50.0);
 		robtk_dial_set_default(ui->delay[i], 0.0);
 		robtk_dial_set_callback(ui->delay[i], cb_set_delay, ui);
 		robtk_dial_annotation_callback(ui->delay[i], dial_annotation_ms, ui);
 		ui->bg_delay[i] = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, ROUTE_WIDTH, STEP_HEIGHT);
 		const float delay_cl[4] = { .3, .3, .4, 1.};
-		dial_faceplate(ui->bg_delay[i], ui, ui->delay[i], "0", "50", delay_cl);
+		dial_faceplate(ui->bg_delay[i], ui, ui->delay[i], "0", delay_max, delay_cl);
 		robtk_dial_set_surface(ui->delay[i], ui->bg_delay[i]);
 		rob_table_attach(ui->ctable, robtk_dial_widget(ui->delay[i]), i+1,i+2, 2,3, 0,0,RTK_EXPAND,RTK_SHRINK);
 
@@ -833,6 +892,9 @@ static RobWidget* setup_toplevel(HarmonigiloUI* ui)
 		robtk_scale_set_callback(ui->gain[i], cb_set_gain, ui);
 		add_scale_markers(ui->gain[i]);
 		rob_table_attach(ui->ctable, robtk_scale_widget(ui->gain[i]), i+1,i+2, 5,6, 0,0,RTK_EXPAND,RTK_SHRINK);
+
+		ui->load[i] = robtk_lbl_new("-");
+		rob_table_attach(ui->ctable, robtk_lbl_widget(ui->load[i]), i+1,i+2, 6,7, 0,0,RTK_EXPAND,RTK_SHRINK);
 	}
 
 	ui->dry_pan = make_sized_robtk_dial(0.0, 1.0, 0.05);
@@ -842,7 +904,7 @@ static RobWidget* setup_toplevel(HarmonigiloUI* ui)
 	robtk_dial_set_default(ui->dry_pan, 0.5);
 	robtk_dial_set_callback(ui->dry_pan, cb_set_dry_pan, ui);
 	robtk_dial_set_surface(ui->dry_pan, ui->bg_dry_pan);
-	rob_table_attach(ui->ctable, robtk_dial_widget(ui->dry_pan), 7,8, 3,4, 0,0,RTK_EXPAND,RTK_SHRINK);
+	rob_table_attach(ui->ctable, robtk_dial_widget(ui->dry_pan), ui->n_voices+1,ui->n_voices+2, 3,4, 0,0,RTK_EXPAND,RTK_SHRINK);
 
 	ui->dry_sm_box = rob_vbox_new(FALSE, 2);
 
@@ -858,16 +920,16 @@ static RobWidget* setup_toplevel(HarmonigiloUI* ui)
 	robtk_cbtn_set_callback(ui->dry_solo, cb_set_dry_solo, ui);
 	rob_vbox_child_pack(ui->dry_sm_box, robtk_cbtn_widget(ui->dry_solo), false, false);
 
-	rob_table_attach(ui->ctable, ui->dry_sm_box, 7,8, 4,5, 0,0,RTK_EXPAND,RTK_SHRINK);
+	rob_table_attach(ui->ctable, ui->dry_sm_box, ui->n_voices+1,ui->n_voices+2, 4,5, 0,0,RTK_EXPAND,RTK_SHRINK);
 
 	ui->dry_gain = robtk_scale_new(-60.f, +6.f, 0.1, false);
 	robtk_scale_set_default(ui->dry_gain, 0.0);
 	robtk_scale_set_callback(ui->dry_gain, cb_set_dry_gain, ui);
 	add_scale_markers(ui->dry_gain);
-	rob_table_attach(ui->ctable, robtk_scale_widget(ui->dry_gain), 7,8, 5,6, 0,0,RTK_EXPAND,RTK_SHRINK);
+	rob_table_attach(ui->ctable, robtk_scale_widget(ui->dry_gain), ui->n_voices+1,ui->n_voices+2, 5,6, 0,0,RTK_EXPAND,RTK_SHRINK);
 
 	ui->lbl_dry = robtk_lbl_new("Dry");
-	rob_table_attach(ui->ctable, robtk_lbl_widget(ui->lbl_dry), 7,8, 0,1, 0,0,RTK_EXPAND,RTK_SHRINK);
+	rob_table_attach(ui->ctable, robtk_lbl_widget(ui->lbl_dry), ui->n_voices+1,ui->n_voices+2, 0,1, 0,0,RTK_EXPAND,RTK_SHRINK);
 
 	ui->lbl_voice_enabled = robtk_lbl_new("Enable");
 	rob_table_attach(ui->ctable, robtk_lbl_widget(ui->lbl_voice_enabled), 0,1, 0,1, 0,0,RTK_EXPAND,RTK_SHRINK);
@@ -879,6 +941,8 @@ static RobWidget* setup_toplevel(HarmonigiloUI* ui)
 	rob_table_attach(ui->ctable, robtk_lbl_widget(ui->lbl_pan), 0,1, 3,4, 0,0,RTK_EXPAND,RTK_SHRINK);
 	ui->lbl_gain = robtk_lbl_new("Gain");
 	rob_table_attach(ui->ctable, robtk_lbl_widget(ui->lbl_gain), 0,1, 5,6, 0,0,RTK_EXPAND,RTK_SHRINK);
+	ui->lbl_load = robtk_lbl_new("DSP");
+	rob_table_attach(ui->ctable, robtk_lbl_widget(ui->lbl_load), 0,1, 6,7, 0,0,RTK_EXPAND,RTK_SHRINK);
 
 	ui->master_box = rob_vbox_new(FALSE, 10);
 
@@ -904,6 +968,14 @@ static RobWidget* setup_toplevel(HarmonigiloUI* ui)
 	ui->lbl_master_dry_wet = robtk_lbl_new("Master Dry/Wet");
 	rob_vbox_child_pack(ui->master_box, robtk_lbl_widget(ui->lbl_master_dry_wet), FALSE, FALSE);
 
+	ui->measure_load = robtk_cbtn_new("DSP load", GBT_LED_LEFT, false);
+	robtk_cbtn_set_callback(ui->measure_load, cb_set_measure_load, ui);
+	rob_vbox_child_pack(ui->master_box, robtk_cbtn_widget(ui->measure_load), FALSE, FALSE);
+	ui->lbl_dsp_load = robtk_lbl_new("-");
+	rob_vbox_child_pack(ui->master_box, robtk_lbl_widget(ui->lbl_dsp_load), FALSE, FALSE);
+	ui->lbl_latency = robtk_lbl_new("Latency");
+	rob_vbox_child_pack(ui->master_box, robtk_lbl_widget(ui->lbl_latency), FALSE, FALSE);
+
 
 	/*
 	printf("dry %x\n", robtk_lbl_widget(ui->lbl_dry));
@@ -943,6 +1015,8 @@ instantiate(void* const ui_toplevel,
 
 	ui->write = write_;
 	ui->controller = controller_;
+	ui->n_voices = hrm_variant_voices(plugin_uri);
+	ui->max_delay = hrm_variant_max_delay(plugin_uri);
 
 	*widget = setup_toplevel(ui);
 	robwidget_make_toplevel(ui->hbox, ui_toplevel);
@@ -967,7 +1041,7 @@ cleanup(LV2UI_Handle handle)
 {
 	HarmonigiloUI* ui = (HarmonigiloUI*) handle;
 
-	for (uint32_t i=0; i<CHAN_NUM; ++i) {
+	for (uint32_t i=0; i<ui->n_voices; ++i) {
 		robtk_cbtn_destroy(ui->voice_enabled[i]);
 		robtk_dial_destroy(ui->pitch[i]);
 		robtk_dial_destroy(ui->delay[i]);
@@ -976,6 +1050,7 @@ cleanup(LV2UI_Handle handle)
 		robtk_cbtn_destroy(ui->mute[i]);
 		robtk_cbtn_destroy(ui->solo[i]);
 		rob_box_destroy(ui->sm_box[i]);
+		robtk_lbl_destroy(ui->load[i]);
 		cairo_surface_destroy(ui->bg_pitch[i]);
 		cairo_surface_destroy(ui->bg_delay[i]);
 		cairo_surface_destroy(ui->bg_pan[i]);
@@ -995,12 +1070,17 @@ cleanup(LV2UI_Handle handle)
 	robtk_lbl_destroy(ui->lbl_delay);
 	robtk_lbl_destroy(ui->lbl_pan);
 	robtk_lbl_destroy(ui->lbl_gain);
+	robtk_lbl_destroy(ui->lbl_load);
 
 	robtk_dial_destroy(ui->master_gain);
 	robtk_dial_destroy(ui->master_dry_wet);
 	robtk_lbl_destroy(ui->lbl_master_gain);
 	robtk_lbl_destroy(ui->lbl_master_dry_wet);
 
+	robtk_cbtn_destroy(ui->measure_load);
+	robtk_lbl_destroy(ui->lbl_dsp_load);
+	robtk_lbl_destroy(ui->lbl_latency);
+
 	cairo_surface_destroy(ui->bg_master_dry_wet);
 	cairo_surface_destroy(ui->bg_master_gain);
 
@@ -1041,10 +1121,10 @@ port_event(LV2UI_Handle handle,
 
 	ui->disable_signals = true;
 
-	const uint32_t num = port/7;
-	if (num < CHAN_NUM) {
+	const uint32_t num = port/HRM_VOICE_PORTS;
+	if (num < ui->n_voices) {
 		//printf("Port: %d %d %d %f\n", port, port/4, port % 4, val);
-		switch ((PortIndex) (port % 7)) {
+		switch ((VoicePortIndex) (port % HRM_VOICE_PORTS)) {
 		case HRM_ENABLED_0:
 			robtk_cbtn_set_active(ui->voice_enabled[num], val>0.5);
 			break;
@@ -1071,8 +1151,10 @@ port_event(LV2UI_Handle handle,
 		default:
 			break;
 		}
+	} else if (port >= hrm_port(ui->n_voices, HRM_VOICE_LOAD_0) && port < hrm_n_ports(ui->n_voices)) {
+		show_load(ui->load[port - hrm_port(ui->n_voices, HRM_VOICE_LOAD_0)], val);
 	} else {
- 		switch ((PortIndex) (port)) {
+ 		switch ((PortIndex) (port - hrm_port(ui->n_voices, 0))) {
 		case HRM_DRY_PAN:
 			robtk_dial_set_value(ui->dry_pan, val);
 			break;
@@ -1081,6 +1163,24 @@ port_event(LV2UI_Handle handle,
 			adjust_master_gain(ui);
 			adjust_master_dry_wet(ui);
 			break;
+		case HRM_MEASURE_LOAD:
+			robtk_cbtn_set_active(ui->measure_load, val>0.5);
+			break;
+		case HRM_DSP_LOAD:
+			show_load(ui->lbl_dsp_load, val);
+			break;
+		case HRM_LATENCY:
+			ui->latency[0] = val;
+			show_latency(ui);
+			break;
+		case HRM_LATENCY_SHIFTER:
+			ui->latency[1] = val;
+			show_latency(ui);
+			break;
+		case HRM_LATENCY_HIDDEN:
+			ui->latency[2] = val;
+			show_latency(ui);
+			break;
 		default:
 			break;
 		}
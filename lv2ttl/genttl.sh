@@ -0,0 +1,83 @@
+#!/bin/sh
+# Writes the plugin description of the variant with the given number of
+# voices to stdout. The port layout is taken from src/harmonigilo.h, first
+# the ports of the voices, then the global ports, then the per voice
+# output ports. The stereo input variant has the default number of voices
+# and appends the right input and the source of each voice. The long delay
+# variant has the default number of voices with a longer range of delays.
+#
+#   genttl.sh <n_voices>|stereo|long
+
+srcdir=`dirname "$0"`
+header="$srcdir/../src/harmonigilo.h"
+
+voice_ports=`sed -n 's/^#define HRM_VOICE_PORTS \([0-9]*\).*/\1/p' "$header"`
+n_globals=`sed -n 's/^[[:space:]]*HRM_VOICE_LOAD_0 = \([0-9]*\).*/\1/p' "$header"`
+default_voices=`sed -n 's/^#define DEFAULT_CHAN_NUM \([0-9]*\).*/\1/p' "$header"`
+max_delay=`sed -n 's/^#define HRM_MAX_DELAY_MS \([0-9.]*\).*/\1/p' "$header"`
+long_max_delay=`sed -n 's/^#define HRM_LONG_MAX_DELAY_MS \([0-9.]*\).*/\1/p' "$header"`
+
+stereo=no
+if test "$1" = stereo; then
+	n_voices=$default_voices
+	stereo=yes
+elif test "$1" = long; then
+	n_voices=$default_voices
+	max_delay=$long_max_delay
+else
+	n_voices=$1
+fi
+
+global_base=`expr $voice_ports \* $n_voices`
+load_base=`expr $global_base + $n_globals`
+input_r_index=`expr $load_base + $n_voices`
+
+if test $stereo = yes; then
+	variant_name=" Stereo"
+elif test "$1" = long; then
+	variant_name=" Long Delay"
+elif test "$n_voices" -eq "$default_voices"; then
+	variant_name=""
+else
+	variant_name=" $n_voices Voices"
+fi
+
+sed "s/@VARIANT_NAME@/$variant_name/g" "$srcdir/harmonigilo.lv2.ttl.in"
+
+{
+	v=0
+	while test $v -lt $n_voices; do
+		base=`expr $voice_ports \* $v`
+		sed "s/@VOICE@/`expr $v + 1`/g
+		     s/@ENABLE_INDEX@/$base/
+		     s/@DELAY_INDEX@/`expr $base + 1`/
+		     s/@PITCH_INDEX@/`expr $base + 2`/
+		     s/@PAN_INDEX@/`expr $base + 3`/
+		     s/@GAIN_INDEX@/`expr $base + 4`/
+		     s/@MUTE_INDEX@/`expr $base + 5`/
+		     s/@SOLO_INDEX@/`expr $base + 6`/
+		     s/@LOAD_INDEX@/`expr $load_base + $v`/
+		     s/@DELAY_MAX@/$max_delay/" \
+		    "$srcdir/harmonigilo.voice.ttl.in"
+		v=`expr $v + 1`
+	done
+
+	awk -v base=$global_base '{
+		while (match($0, /@GLOBAL_[0-9]+@/)) {
+			idx = base + substr($0, RSTART+8, RLENGTH-9)
+			$0 = substr($0, 1, RSTART-1) idx substr($0, RSTART+RLENGTH)
+		}
+		print
+	}' "$srcdir/harmonigilo.global.ttl.in"
+
+	if test $stereo = yes; then
+		sed "s/@INPUT_R_INDEX@/$input_r_index/" "$srcdir/harmonigilo.stereo.ttl.in"
+		v=0
+		while test $v -lt $n_voices; do
+			sed "s/@VOICE@/`expr $v + 1`/g
+			     s/@SOURCE_INDEX@/`expr $input_r_index + 1 + $v`/" \
+			    "$srcdir/harmonigilo.source.ttl.in"
+			v=`expr $v + 1`
+		done
+	fi
+} | sed '$s/\] , \[$/] ./'
@@ -0,0 +1,137 @@
+/*
+    Copyright (C) 2016 Johannes Mueller <github@johannes-mueller.org>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    version 2 as published by the Free Software Foundation;
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * The memory of the DSP in one piece, allocated at instantiate(). What is
+ * carved from it is aligned to cache lines and zeroed, and it is given
+ * back only all at once.
+ *
+ * The size is found out by going through the allocations with an arena
+ * that has no memory yet, which only counts and hands out NULL. Then the
+ * memory is reserved and the allocations are done again for real.
+ *
+ * The memory is touched page by page right when it is reserved, so that
+ * the audio thread doesn't take the page faults. Built with
+ * HRM_LOCK_MEMORY it is also locked, so that it isn't paged out under
+ * memory pressure. If the memory lock limit doesn't allow it, the arena
+ * just stays unlocked.
+ */
+
+#ifndef HRM_ARENA_H
+#define HRM_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#elif defined HRM_LOCK_MEMORY
+#include <sys/mman.h>
+#endif
+
+#include "harmonigilo.h"
+
+typedef struct {
+	char* base;
+	size_t size;
+	size_t used;
+	bool locked;
+} Arena;
+
+static void*
+cache_aligned_alloc(size_t size)
+{
+#ifdef _WIN32
+	return _aligned_malloc(size, CACHE_LINE);
+#else
+	void* p;
+	return posix_memalign(&p, CACHE_LINE, size) ? NULL : p;
+#endif
+}
+
+static void
+cache_aligned_free(void* p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+static void
+init_arena(Arena* a)
+{
+	a->base = NULL;
+	a->size = a->used = 0;
+	a->locked = false;
+}
+
+static inline bool
+arena_counting(const Arena* a)
+{
+	return !a->base;
+}
+
+/* len bytes from the arena, NULL if it only counts or is used up */
+static void*
+arena_alloc(Arena* a, size_t len)
+{
+	const size_t at = (a->used + CACHE_LINE-1) & ~(size_t)(CACHE_LINE-1);
+	if (a->base && at + len > a->size) {
+		return NULL;
+	}
+	a->used = at + len;
+	return a->base ? a->base + at : NULL;
+}
+
+/* reserves what has been counted and starts handing it out */
+static bool
+arena_reserve(Arena* a)
+{
+	const size_t size = a->used;
+	a->base = (char*)cache_aligned_alloc(size);
+	if (!a->base) {
+		return false;
+	}
+	a->size = size;
+	a->used = 0;
+	memset(a->base, 0, size);
+#if defined HRM_LOCK_MEMORY && !defined _WIN32
+	a->locked = mlock(a->base, size) == 0;
+#endif
+	return true;
+}
+
+static void
+arena_release(Arena* a)
+{
+	if (!a->base) {
+		return;
+	}
+#if defined HRM_LOCK_MEMORY && !defined _WIN32
+	if (a->locked) {
+		munlock(a->base, a->size);
+	}
+#endif
+	cache_aligned_free(a->base);
+	init_arena(a);
+}
+
+#endif // HRM_ARENA_H
@@ -0,0 +1,61 @@
+/*
+    Copyright (C) 2016 Johannes Mueller <github@johannes-mueller.org>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    version 2 as published by the Free Software Foundation;
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * A monotonic clock in nanoseconds to measure the DSP load. It is cheap
+ * enough to be read a couple of times per voice and period, none of the
+ * variants takes a lock or makes a real system call.
+ */
+
+#ifndef HRM_DSP_CLOCK_H
+#define HRM_DSP_CLOCK_H
+
+#include <stdint.h>
+
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#elif defined _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static inline uint64_t
+dsp_clock_now(void)
+{
+#ifdef __APPLE__
+	static mach_timebase_info_data_t tb;
+	if (tb.denom == 0) {
+		mach_timebase_info(&tb);
+	}
+	return mach_absolute_time() * tb.numer / tb.denom;
+#elif defined _WIN32
+	static LARGE_INTEGER freq;
+	if (freq.QuadPart == 0) {
+		QueryPerformanceFrequency(&freq);
+	}
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return (uint64_t) (t.QuadPart * (1e9 / freq.QuadPart));
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+#endif // HRM_DSP_CLOCK_H
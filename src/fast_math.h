@@ -0,0 +1,158 @@
+/*
+    Copyright (C) 2016 Johannes Mueller <github@johannes-mueller.org>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    version 2 as published by the Free Software Foundation;
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Fast approximations of the exponentials and logarithms behind decibels
+ * and cents, shared by the DSP and the GUI. The exponential doesn't branch
+ * on the value and comes as a block variant as well, that takes four
+ * values at once with SSE2.
+ *
+ *   fast_exp2f()   relative error below FAST_EXP2_MAX_ERROR, 2^x of x
+ *                  below -126 is 2^-126 and of x above 127 it is 2^127
+ *   fast_log2f()   error below FAST_LOG2_MAX_ERROR, absolute for x between
+ *                  1/2 and 2 and relative to log2(x) beyond, -inf for 0,
+ *                  positive denormals are taken as the smallest normal
+ *
+ * The bounds are checked against libm by the benchmark.
+ */
+
+#ifndef HRM_FAST_MATH_H
+#define HRM_FAST_MATH_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define FAST_EXP2_MAX_ERROR 3e-7f
+#define FAST_LOG2_MAX_ERROR 3e-7f
+
+#define FAST_LOG2_10 3.32192809488736234787f
+#define FAST_LOG10_2 0.30102999566398119521f
+
+// ln(2)^k/k!, the Taylor series of 2^f up to f^6, |f| <= 0.5
+#define EXP2_C1 0.69314718055994530942f
+#define EXP2_C2 0.24022650695910071233f
+#define EXP2_C3 0.05550410866482157995f
+#define EXP2_C4 0.00961812910762847716f
+#define EXP2_C5 0.00133335581464284434f
+#define EXP2_C6 0.00015403530393381609f
+
+static inline float
+exp2_poly(float f)
+{
+	return 1.f + f*(EXP2_C1 + f*(EXP2_C2 + f*(EXP2_C3 + f*(EXP2_C4 + f*(EXP2_C5 + f*EXP2_C6)))));
+}
+
+static inline float
+fast_exp2f(float x)
+{
+	x = x < -126.f ? -126.f : x > 127.f ? 127.f : x;
+	// rounded to the nearest, x + 128.5 is positive, so the cast floors it
+	const int32_t n = (int32_t)(x + 128.5f) - 128;
+	const int32_t bits = (n + 127) << 23;
+	float scale;
+	memcpy(&scale, &bits, sizeof(float));
+	return exp2_poly(x - (float)n) * scale;
+}
+
+/* the mantissa m is taken between sqrt(1/2) and sqrt(2), so that
+ * t = (m-1)/(m+1) stays below 0.172 and the series of atanh converges
+ * after four terms */
+static inline float
+fast_log2f(float x)
+{
+	if (!(x > 0.f)) {
+		return -INFINITY;
+	}
+	int32_t bits;
+	memcpy(&bits, &x, sizeof(float));
+	bits = bits < (1 << 23) ? 1 << 23 : bits;
+
+	// the mantissa in [1, 2), and the exponent bumped for the ones above sqrt(2)
+	const int32_t hi = (bits & 0x007fffff) >= 0x3504f3 ? 1 : 0;
+	const int32_t e = ((bits >> 23) & 0xff) - 127 + hi;
+	const int32_t mbits = (bits & 0x007fffff) | ((127 - hi) << 23);
+	float m;
+	memcpy(&m, &mbits, sizeof(float));
+
+	const float t = (m - 1.f) / (m + 1.f);
+	const float t2 = t*t;
+	const float s = t*(2.f + t2*(2.f/3.f + t2*(2.f/5.f + t2*(2.f/7.f))));
+	return (float)e + s * 1.44269504088896340736f;
+}
+
+static inline float
+db_to_gain(float db)
+{
+	return fast_exp2f(db * (FAST_LOG2_10/20.f));
+}
+
+static inline float
+gain_to_db(float gain)
+{
+	return fast_log2f(gain) * (20.f*FAST_LOG10_2);
+}
+
+/* the frequency ratio of a pitch shift */
+static inline float
+cents_to_ratio(float cents)
+{
+	return fast_exp2f(cents * (1.f/1200.f));
+}
+
+/* out[i] = fast_exp2f(scale * x[i]), out may be x */
+static void
+exp2_block(const float* x, float* out, float scale, uint32_t n)
+{
+	uint32_t i = 0;
+#ifdef __SSE2__
+	const __m128 s = _mm_set1_ps(scale);
+	const __m128 lo = _mm_set1_ps(-126.f);
+	const __m128 hi = _mm_set1_ps(127.f);
+	const __m128i bias = _mm_set1_epi32(127);
+	for (; i+4 <= n; i+=4) {
+		const __m128 v = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(x + i), s), lo), hi);
+		// rounds to the nearest with the default MXCSR
+		const __m128i k = _mm_cvtps_epi32(v);
+		const __m128 f = _mm_sub_ps(v, _mm_cvtepi32_ps(k));
+		__m128 p = _mm_set1_ps(EXP2_C6);
+		p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_C5));
+		p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_C4));
+		p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_C3));
+		p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_C2));
+		p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(EXP2_C1));
+		p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.f));
+		const __m128 scale2 = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(k, bias), 23));
+		_mm_storeu_ps(out + i, _mm_mul_ps(p, scale2));
+	}
+#endif
+	for (; i<n; ++i) {
+		out[i] = fast_exp2f(scale * x[i]);
+	}
+}
+
+static void
+db_to_gain_block(const float* db, float* gain, uint32_t n)
+{
+	exp2_block(db, gain, FAST_LOG2_10/20.f, n);
+}
+
+#endif // HRM_FAST_MATH_H
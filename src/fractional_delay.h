@@ -0,0 +1,227 @@
+/*
+    Copyright (C) 2016 Johannes Mueller <github@johannes-mueller.org>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    version 2 as published by the Free Software Foundation;
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Reading a ring buffer between its samples, and what moves the read
+ * position. The interpolators take the position x in samples, which may
+ * be negative by up to the length of the ring. The ring has to be mirrored
+ * past its end as far as x goes beyond it.
+ *
+ *   cubic            4 point Catmull-Rom spline
+ *   allpass          first order Thiran allpass, flat magnitude, but it
+ *                    has a state and smears fast delay changes
+ *   windowed sinc    8 taps, Blackman windowed, from a table of phases
+ *
+ * The modulation comes from two tables of one cycle each, a sine and a
+ * random walk, that is smoothed and closed to a loop. They are read with
+ * a phase per voice, so the per sample cost doesn't depend on the source.
+ */
+
+#ifndef HRM_FRACTIONAL_DELAY_H
+#define HRM_FRACTIONAL_DELAY_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "harmonigilo.h"
+
+#define SINC_TAPS 8
+#define SINC_PHASES 256
+
+// the interpolators read this far ahead of x, so a delay must be at least as long
+#define INTERP_MIN_DELAY (SINC_TAPS/2)
+
+#define MOD_TABLE_SIZE 1024
+
+typedef struct {
+	float kernel[SINC_PHASES+1][SINC_TAPS];
+} SincTable;
+
+typedef struct {
+	float table[HRM_N_MOD_SOURCES][MOD_TABLE_SIZE+1];
+} ModTable;
+
+static void
+init_sinc_table(SincTable* st)
+{
+	const double pi = 3.14159265358979323846;
+	const double half = SINC_TAPS/2;
+	for (uint32_t p=0; p<=SINC_PHASES; ++p) {
+		const double t = (double)p / SINC_PHASES;
+		double sum = 0.0;
+		double h[SINC_TAPS];
+		for (uint32_t k=0; k<SINC_TAPS; ++k) {
+			// the tap at x - t + k - (half-1)
+			const double u = k - (half-1) - t;
+			const double sinc = fabs(u) < 1e-9 ? 1.0 : sin(pi*u) / (pi*u);
+			const double w = 0.42 + 0.5*cos(pi*u/half) + 0.08*cos(2.0*pi*u/half);
+			h[k] = sinc * w;
+			sum += h[k];
+		}
+		for (uint32_t k=0; k<SINC_TAPS; ++k) {
+			st->kernel[p][k] = (float)(h[k] / sum);
+		}
+	}
+}
+
+/* the ring is mirrored past its end, so only what lies before it wraps */
+static inline float
+ring_sample(const float* data, size_t len, long i)
+{
+	return data[i < 0 ? i + (long)len : i];
+}
+
+static inline float
+interp_cubic(const float* data, size_t len, float x)
+{
+	const float fi = floorf(x);
+	const float t = x - fi;
+	const long i = (long)fi;
+	const float y0 = ring_sample(data, len, i-1);
+	const float y1 = ring_sample(data, len, i);
+	const float y2 = ring_sample(data, len, i+1);
+	const float y3 = ring_sample(data, len, i+2);
+	const float a = 0.5f*(y3 - y0) + 1.5f*(y1 - y2);
+	const float b = y0 - 2.5f*y1 + 2.f*y2 - 0.5f*y3;
+	const float c = 0.5f*(y2 - y0);
+	return ((a*t + b)*t + c)*t + y1;
+}
+
+static inline float
+interp_sinc(const SincTable* st, const float* data, size_t len, float x)
+{
+	const float fi = floorf(x);
+	const long i = (long)fi - (SINC_TAPS/2 - 1);
+	const float* h = st->kernel[(uint32_t)((x - fi) * SINC_PHASES + 0.5f)];
+	float y = 0.f;
+	for (uint32_t k=0; k<SINC_TAPS; ++k) {
+		y += h[k] * ring_sample(data, len, i+k);
+	}
+	return y;
+}
+
+/* reads at position pos delayed by delay, y1 is the last output. The
+ * fraction is kept between 0.5 and 1.5, where the allpass is stable and
+ * its phase is close to linear. */
+static inline float
+interp_allpass(const float* data, size_t len, long pos, float delay, float* y1)
+{
+	float di = floorf(delay);
+	float f = delay - di;
+	if (f < 0.5f) {
+		di -= 1.f;
+		f += 1.f;
+	}
+	const float a = (1.f - f) / (1.f + f);
+	const long i = pos - (long)di;
+	const float y = a * ring_sample(data, len, i) + ring_sample(data, len, i-1) - a * *y1;
+	*y1 = y;
+	return y;
+}
+
+/* a pseudo random number between -1 and 1 */
+static inline float
+mod_random(uint32_t* seed)
+{
+	*seed = *seed * 1664525u + 1013904223u;
+	return (float)(*seed >> 8) / (float)(1u << 23) - 1.f;
+}
+
+static void
+smooth_mod_table(float* t, uint32_t width)
+{
+	float tmp[MOD_TABLE_SIZE];
+	for (uint32_t i=0; i<MOD_TABLE_SIZE; ++i) {
+		float sum = 0.f;
+		for (uint32_t k=0; k<width; ++k) {
+			sum += t[(i + k) % MOD_TABLE_SIZE];
+		}
+		tmp[i] = sum / width;
+	}
+	for (uint32_t i=0; i<MOD_TABLE_SIZE; ++i) {
+		t[i] = tmp[i];
+	}
+}
+
+static void
+init_mod_table(ModTable* mt)
+{
+	const double pi = 3.14159265358979323846;
+	float* off = mt->table[HRM_MOD_OFF];
+	float* lfo = mt->table[HRM_MOD_LFO];
+	float* walk = mt->table[HRM_MOD_RANDOM];
+
+	for (uint32_t i=0; i<MOD_TABLE_SIZE; ++i) {
+		off[i] = 0.f;
+		lfo[i] = (float) sin(2.0*pi*i/MOD_TABLE_SIZE);
+	}
+
+	// the walk, with its drift taken out, so that it ends where it started
+	uint32_t seed = 0x2016u;
+	float pos = 0.f;
+	for (uint32_t i=0; i<MOD_TABLE_SIZE; ++i) {
+		pos += mod_random(&seed);
+		walk[i] = pos;
+	}
+	const float drift = walk[MOD_TABLE_SIZE-1] / MOD_TABLE_SIZE;
+	for (uint32_t i=0; i<MOD_TABLE_SIZE; ++i) {
+		walk[i] -= drift * (i+1);
+	}
+	smooth_mod_table(walk, MOD_TABLE_SIZE/32);
+	smooth_mod_table(walk, MOD_TABLE_SIZE/32);
+
+	float lo = walk[0];
+	float hi = walk[0];
+	for (uint32_t i=1; i<MOD_TABLE_SIZE; ++i) {
+		lo = fminf(lo, walk[i]);
+		hi = fmaxf(hi, walk[i]);
+	}
+	for (uint32_t i=0; i<MOD_TABLE_SIZE; ++i) {
+		walk[i] = hi > lo ? 2.f * (walk[i] - lo) / (hi - lo) - 1.f : 0.f;
+	}
+
+	for (uint32_t s=0; s<HRM_N_MOD_SOURCES; ++s) {
+		mt->table[s][MOD_TABLE_SIZE] = mt->table[s][0];
+	}
+}
+
+/*
+ * Adds the modulation to the delays d of a block. The delay only grows by
+ * the modulation, from 0 to depth, so that it never eats into the latency
+ * the delay has to cover. The depth moves by depth_step per sample.
+ */
+static inline void
+mod_table_add(const ModTable* mt, ModSource src, double* phase, double inc,
+	      float depth, float depth_step, float* d, uint32_t n_samples)
+{
+	const float* t = mt->table[src];
+	double p = *phase;
+	for (uint32_t i=0; i<n_samples; ++i) {
+		const uint32_t k = (uint32_t)p;
+		const float frac = (float)(p - k);
+		const float m = t[k] + frac * (t[k+1] - t[k]);
+		d[i] += 0.5f * (depth + depth_step*i) * (1.f + m);
+		p += inc;
+		if (p >= MOD_TABLE_SIZE) {
+			p -= MOD_TABLE_SIZE;
+		}
+	}
+	*phase = p;
+}
+
+#endif // HRM_FRACTIONAL_DELAY_H
@@ -15,22 +15,86 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+// clock_gettime() and bzero() are hidden by -std=c99 otherwise
+#define _GNU_SOURCE
+
 #include <assert.h>
 #include <math.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <strings.h>
 #include <string.h>
+#include <sched.h>
 
 #include <stdio.h> // for debug outputs
 
 #include <rubberband/rubberband-c.h>
 
 #include "lv2/lv2plug.in/ns/lv2core/lv2.h"
+#include "lv2/lv2plug.in/ns/ext/atom/atom.h"
+#include "lv2/lv2plug.in/ns/ext/buf-size/buf-size.h"
+#include "lv2/lv2plug.in/ns/ext/options/options.h"
+#include "lv2/lv2plug.in/ns/ext/state/state.h"
+#include "lv2/lv2plug.in/ns/ext/urid/urid.h"
 
 #include "harmonigilo.h"
-
-#define BUFLEN 8192
+#include "arena.h"
+#include "worker_pool.h"
+#include "phase_vocoder.h"
+#include "mixdown.h"
+#include "pan_law.h"
+#include "snapshot.h"
+#include "fractional_delay.h"
+#include "shared_engine.h"
+#include "dsp_clock.h"
+#include "fast_math.h"
+
+// longer blocks of the host are processed in sub-blocks of this length, so
+// that the working set stays in the cache and the scratch buffers small
+#define SUB_BLOCK_LEN 256
+// the scratch buffers of each voice are a sub-block long
+#define VOICE_SCRATCH_BUFFERS 3
+
+// window of the delay line pitch shifter, long enough for a smooth sweep at
+// +-50 cents, short enough to stay hidden behind the usual voice delays
+#define SHIFT_WINDOW_MS 20.0
+#define SHIFT_MIN_DELAY 1.0
+// live mode shrinks the window down to this to fit the latency budget
+#define SHIFT_WINDOW_MIN_MS 5.0
+
+// the pitch buffers hold the longest delay of the variant, the modulation
+// on top of it and this much for the latency of the pitch shifters that is
+// reported on top of the shorter delays
+#define DELAY_HEADROOM_MS 100.0
+#define MOD_DEPTH_MAX_MS 5.0
+
+// crossfade between the shifted voice and the voice read straight from the
+// input once its pitch has reached the dead zone or left it
+#define DIRECT_FADE_MS 20.0
+
+// a voice primed from the input history shifts at most this many
+// sub-blocks of it per sub-block, so waking up from a bypass spreads over
+// the next periods. As many voices at once as there are threads to
+// process them, serial just one.
+#define PRIME_BLOCKS 4
+
+// time constant of gain, pan and pitch changes
+#define RAMP_TIME_MS 20.0
+#define RAMP_EPSILON 1e-5f
+// delay changes move at most this many samples per sample, a doppler
+// shift of about 50 cents while the delay moves
+#define DELAY_SLEW (1.f/32.f)
+
+// crossfade between the processed and the bypassed signal
+#define BYPASS_FADE_MS 10.0
+// the bypassed mono input goes to both sides at -3 dB
+#define BYPASS_GAIN_MONO 0.70710678118654752440f
+
+// the lowest silence threshold switches the gate off
+#define GATE_OFF_DB -120.f
+
+// time constant of the averaged DSP load
+#define LOAD_TIME_MS 300.0
 
 #ifndef MIN
 #define MIN(A,B) ( (A) < (B) ? (A) : (B) )
@@ -41,48 +105,182 @@
 
 static inline float
 from_dB(float gdb) {
-	return (exp(gdb/20.f*log(10.f)));
+	return db_to_gain(gdb);
+}
+
+/*
+ * Smoothing of a parameter. A new value is approached once per block,
+ * inside the block the parameter moves linearly by step per sample.
+ */
+typedef struct {
+	float start;
+	float current;
+	float target;
+	float step;
+} Ramp;
+
+static inline void
+snap_ramp(Ramp* r, float value)
+{
+	r->start = r->current = r->target = value;
+	r->step = 0.f;
+}
+
+static inline bool
+ramp_active(const Ramp* r)
+{
+	return r->step != 0.f;
+}
+
+/* one-pole approach to target, coeff is the decay over n_samples */
+static inline void
+ramp_run(Ramp* r, float target, float coeff, uint32_t n_samples)
+{
+	r->start = r->current;
+	r->target = target;
+	if (r->current == target) {
+		r->step = 0.f;
+		return;
+	}
+	float end = target + (r->current - target) * coeff;
+	if (fabsf(end - target) < RAMP_EPSILON) {
+		end = target;
+	}
+	r->step = (end - r->current) / n_samples;
+	r->current = end;
+}
+
+/* linear approach to target with at most max_step per sample */
+static inline void
+ramp_run_linear(Ramp* r, float target, float max_step, uint32_t n_samples)
+{
+	r->start = r->current;
+	r->target = target;
+	if (r->current == target) {
+		r->step = 0.f;
+		return;
+	}
+	const float max_diff = max_step * n_samples;
+	float end = target;
+	if (target - r->current > max_diff) {
+		end = r->current + max_diff;
+	} else if (r->current - target > max_diff) {
+		end = r->current - max_diff;
+	}
+	r->step = (end - r->current) / n_samples;
+	r->current = end;
+}
+
+/*
+ * The ramps of all voices side by side, indexed by the voice. They run
+ * like the ramps above, just without branches, so that the compiler runs
+ * them for several voices at once. A ramp whose target is its current
+ * value stands still.
+ */
+typedef struct {
+	float start[MAX_CHAN_NUM] CACHE_ALIGNED;
+	float current[MAX_CHAN_NUM] CACHE_ALIGNED;
+	float target[MAX_CHAN_NUM] CACHE_ALIGNED;
+	float step[MAX_CHAN_NUM] CACHE_ALIGNED;
+} RampBank;
+
+static void
+ramp_bank_hold(RampBank* rb, uint32_t n_voices)
+{
+	for (uint32_t v=0; v<n_voices; ++v) {
+		rb->target[v] = rb->current[v];
+	}
+}
+
+static void
+ramp_bank_snap(RampBank* rb, uint32_t n_voices)
+{
+	for (uint32_t v=0; v<n_voices; ++v) {
+		rb->start[v] = rb->current[v] = rb->target[v];
+		rb->step[v] = 0.f;
+	}
+}
+
+static inline bool
+ramp_bank_active(const RampBank* rb, uint32_t v)
+{
+	return rb->step[v] != 0.f;
+}
+
+static void
+ramp_bank_run(RampBank* rb, float coeff, uint32_t n_voices, uint32_t n_samples)
+{
+	for (uint32_t v=0; v<n_voices; ++v) {
+		const float current = rb->current[v];
+		const float target = rb->target[v];
+		float end = target + (current - target) * coeff;
+		end = fabsf(end - target) < RAMP_EPSILON ? target : end;
+		rb->start[v] = current;
+		rb->step[v] = (end - current) / n_samples;
+		rb->current[v] = end;
+	}
+}
+
+static void
+ramp_bank_run_linear(RampBank* rb, float max_step, uint32_t n_voices, uint32_t n_samples)
+{
+	const float max_diff = max_step * n_samples;
+	for (uint32_t v=0; v<n_voices; ++v) {
+		const float current = rb->current[v];
+		const float diff = rb->target[v] - current;
+		const float end = fabsf(diff) <= max_diff ? rb->target[v] : current + copysignf(max_diff, diff);
+		rb->start[v] = current;
+		rb->step[v] = (end - current) / n_samples;
+		rb->current[v] = end;
+	}
 }
 
+/*
+ * Ring buffer of samples. The first mirror samples are mirrored behind the
+ * end, so that any read of up to mirror samples is one pointer into
+ * contiguous memory, wherever it starts. Whatever is written is copied to
+ * the mirror as it is committed.
+ */
 typedef struct {
 	float* data;
 	size_t len;
+	size_t mirror;
 	size_t write_pos, read_pos;
 } SampleBuffer;
 
 static SampleBuffer*
-new_sample_buffer(size_t len)
+new_sample_buffer(Arena* arena, size_t len, size_t mirror)
 {
-	float* data = (float*)calloc(len, sizeof(float));
-	if (!data) {
-		return NULL;
-	}
-	SampleBuffer* sb = (SampleBuffer*)malloc(sizeof(SampleBuffer));
-	if (!sb) {
+	SampleBuffer* sb = (SampleBuffer*)arena_alloc(arena, sizeof(SampleBuffer));
+	float* data = (float*)arena_alloc(arena, (len+mirror)*sizeof(float));
+	if (!sb || !data) {
 		return NULL;
 	}
 	sb->data = data;
 	sb->len = len;
+	sb->mirror = mirror;
 	sb->write_pos = 0;
 	sb->read_pos = 0;
 	return sb;
 }
 
-static void
-delete_sample_buffer(SampleBuffer* sb)
-{
-	free(sb->data);
-	free(sb);
-}
-
 static void
 reset_sample_buffer(SampleBuffer* sb)
 {
-	bzero(sb->data, sb->len*sizeof(float));
+	bzero(sb->data, (sb->len+sb->mirror)*sizeof(float));
 	sb->read_pos = 0;
 	sb->write_pos = 0;
 }
 
+/* copies what of the n samples written at pos lies in the mirrored head */
+static inline void
+mirror_sample_buffer(SampleBuffer* sb, size_t pos, size_t n)
+{
+	if (pos < sb->mirror) {
+		memcpy(sb->data + sb->len + pos, sb->data + pos, (MIN(pos+n, sb->mirror) - pos)*sizeof(float));
+	}
+}
+
 static void
 put_to_sample_buffer(SampleBuffer* sb, const float* data, size_t len)
 {
@@ -91,6 +289,7 @@ put_to_sample_buffer(SampleBuffer* sb, const float* data, size_t len)
 	const size_t c = sb->len - sb->write_pos;
 	if (c >= len) {
 		memcpy (sb->data + sb->write_pos, data, len*sizeof(float));
+		mirror_sample_buffer(sb, sb->write_pos, len);
 		sb->write_pos += len;
 		if (sb->write_pos == sb->len) {
 			sb->write_pos = 0;
@@ -98,10 +297,30 @@ put_to_sample_buffer(SampleBuffer* sb, const float* data, size_t len)
 	} else {
 		memcpy (sb->data + sb->write_pos, data, c*sizeof(float));
 		memcpy (sb->data, data+c, (len-c)*sizeof(float));
+		mirror_sample_buffer(sb, 0, len-c);
 		sb->write_pos = len-c;
 	}
 }
 
+/* the contiguous space from the write position up to the end of the buffer,
+ * what the caller writes there is committed by sample_buffer_advance_write_pos() */
+static float*
+get_write_span_of_sample_buffer(SampleBuffer* sb, size_t* len)
+{
+	*len = sb->len - sb->write_pos;
+	return sb->data + sb->write_pos;
+}
+
+static void
+sample_buffer_advance_write_pos(SampleBuffer* sb, size_t inc)
+{
+	mirror_sample_buffer(sb, sb->write_pos, inc);
+	sb->write_pos += inc;
+	if (sb->write_pos >= sb->len) {
+		sb->write_pos -= sb->len;
+	}
+}
+
 static uint32_t
 calc_sample_buffer_pos(const SampleBuffer* sb, int rel_pos)
 {
@@ -125,44 +344,167 @@ sample_buffer_advance_read_pos(SampleBuffer* sb, size_t inc)
 	}
 }
 
+/*
+ * How many of the len samples at rel_pos have been written. The ones that
+ * haven't are at the end, the write position lies within them. None have
+ * if the buffer is stalled with the read position at the write position.
+ */
+static size_t
+sample_buffer_written(const SampleBuffer* sb, int rel_pos, size_t len)
+{
+	if (sb->write_pos == sb->read_pos) {
+		return 0;
+	}
+	const size_t pos = calc_sample_buffer_pos(sb, rel_pos);
+	if (pos < sb->write_pos && sb->write_pos - pos < len) {
+		return sb->write_pos - pos;
+	}
+	return len;
+}
+
+/* true if all of the len samples at rel_pos have been written */
+static bool
+sample_buffer_span_written(const SampleBuffer* sb, int rel_pos, size_t len)
+{
+	return sample_buffer_written(sb, rel_pos, len) == len;
+}
+
+/*
+ * Fetches len samples at rel_pos. What hasn't been written yet is padded
+ * with silence in front and the read position only moves on by what has,
+ * so the voice goes on right from there with the next block.
+ */
 static void
 get_from_sample_buffer(SampleBuffer* sb, int rel_pos, float* dst, size_t len)
+{
+	assert (len <= sb->mirror);
+
+	const size_t n = sample_buffer_written(sb, rel_pos, len);
+	memset(dst, 0, (len-n)*sizeof(float));
+	memcpy(dst + len-n, sb->data + calc_sample_buffer_pos(sb, rel_pos), n*sizeof(float));
+	sample_buffer_advance_read_pos(sb, n);
+}
+
+/* linear interpolated read at delay samples before the absolute position
+ * pos, which may be up to the mirror past the end */
+static inline float
+get_frac_sample_from_sample_buffer(const SampleBuffer* sb, long pos, float delay)
+{
+	const float x = (float)pos - delay;
+	long i0 = (long)floorf(x);
+	const float frac = x - (float)i0;
+	if (i0 < 0) {
+		i0 += sb->len;
+	}
+	const float a = sb->data[i0];
+	return a + frac*(sb->data[i0+1]-a);
+}
+
+/* reads len samples from the absolute position pos on, each with its own
+ * fractional delay, which has to be between INTERP_MIN_DELAY and the
+ * length of the buffer less len. The allpass keeps its last output in y1. */
+static void
+interpolate_sample_buffer(const SampleBuffer* sb, long pos, const float* delay, DelayInterpolation interp,
+			  const SincTable* st, float* y1, float* dst, size_t len)
+{
+	assert (len <= sb->mirror);
+
+	switch (interp) {
+	case HRM_INTERP_ALLPASS:
+		for (size_t i=0; i<len; ++i) {
+			dst[i] = interp_allpass(sb->data, sb->len, pos+i, delay[i], y1);
+		}
+		break;
+	case HRM_INTERP_SINC:
+		for (size_t i=0; i<len; ++i) {
+			dst[i] = interp_sinc(st, sb->data, sb->len, (float)(pos+i) - delay[i]);
+		}
+		break;
+	case HRM_INTERP_CUBIC:
+	default:
+		for (size_t i=0; i<len; ++i) {
+			dst[i] = interp_cubic(sb->data, sb->len, (float)(pos+i) - delay[i]);
+		}
+		break;
+	}
+}
+
+/* like get_from_sample_buffer() but with a fractional delay for each sample */
+static void
+get_interpolated_from_sample_buffer(SampleBuffer* sb, const float* delay, DelayInterpolation interp,
+				    const SincTable* st, float* y1, float* dst, size_t len)
 {
 	if (sb->write_pos == sb->read_pos) {
 		memset(dst, 0, len*sizeof(float));
 		return;
 	}
-	uint32_t pos = calc_sample_buffer_pos(sb, rel_pos);
-	if (pos < sb->write_pos && pos > sb->write_pos-len) {
-		const uint32_t d = len-(sb->write_pos-pos);
-		memset(dst, 0, d*sizeof(float));
-		memcpy(dst+d, sb->data+pos, (len-d)*sizeof(float));
-		sample_buffer_advance_read_pos(sb, len-d);
-		return;
-	}
-	if (pos+len > sb->len) {
-		const size_t c = sb->len-pos;
-		memcpy(dst, sb->data+pos, c*sizeof(float));
-		memcpy(dst+c, sb->data, (len-c)*sizeof(float));
-		sb->read_pos = (len-c-rel_pos);
-	} else {
-		memcpy(dst, sb->data+pos, len*sizeof(float));
-		sample_buffer_advance_read_pos(sb, len);
+	interpolate_sample_buffer(sb, sb->read_pos, delay, interp, st, y1, dst, len);
+	sample_buffer_advance_read_pos(sb, len);
+}
+
+/* writes len samples of silence */
+static void
+put_silence_to_sample_buffer(SampleBuffer* sb, size_t len)
+{
+	while (len > 0) {
+		size_t space;
+		float* dst = get_write_span_of_sample_buffer(sb, &space);
+		const size_t n = MIN(len, space);
+		memset(dst, 0, n*sizeof(float));
+		sample_buffer_advance_write_pos(sb, n);
+		len -= n;
 	}
 }
 
-static float
-get_sample_from_sample_buffer(SampleBuffer* sb, int rel_pos)
+/* the len samples at rel_pos in one piece, the read position stays */
+static const float*
+peek_span_of_sample_buffer(const SampleBuffer* sb, int rel_pos, size_t len)
+{
+	assert (len <= sb->mirror);
+
+	return sb->data + calc_sample_buffer_pos(sb, rel_pos);
+}
+
+/* the len samples at rel_pos in one piece, as if they had been fetched */
+static const float*
+get_span_from_sample_buffer(SampleBuffer* sb, int rel_pos, size_t len)
+{
+	const float* span = peek_span_of_sample_buffer(sb, rel_pos, len);
+	sample_buffer_advance_read_pos(sb, len);
+	return span;
+}
+
+/* the len samples written before the last lag samples in one piece */
+static const float*
+get_past_span_of_sample_buffer(const SampleBuffer* sb, size_t lag, size_t len)
 {
-	uint32_t pos = calc_sample_buffer_pos(sb, rel_pos);
-	assert(pos>=0);
-	assert(pos<sb->len);
-	sample_buffer_advance_read_pos(sb, 1);
-	return sb->data[pos];
+	assert (len <= sb->mirror && lag + len <= sb->len);
+
+	long pos = (long)sb->write_pos - (long)(lag + len);
+	if (pos < 0) {
+		pos += sb->len;
+	}
+	return sb->data + pos;
 }
 
 
 
+/*
+ * A signal the voices take as input. Its history feeds the delay line
+ * shifter, the dry signal and the voices that aren't pitch shifted, the
+ * vocoder analysis is shared by all the voices of the source.
+ */
+typedef struct {
+	const float* data;
+	SampleBuffer* history;
+	VocoderAnalysis* analysis;
+	bool analysis_active;
+	bool vocoder_used;
+	bool vocoder_awake;
+	// samples since the input was last above the silence threshold
+	uint32_t quiet;
+} InputSource;
+
 typedef struct {
 	const float* enabled;
 	const float* delay;
@@ -171,19 +513,92 @@ typedef struct {
 	const float* gain;
 	const float* mute;
 	const float* solo;
+	const float* source_sel;
 
+	InputSource* source;
+	// the index of the voice in the VoiceBank
+	uint32_t voice;
+
+	// the delayed voice of this period, mostly straight in the pitch buffer
+	const float* out;
+	// only used if the delay moves or the voice isn't fully written yet
 	float* delay_buffer;
+	// the unshifted voice while it is crossfaded with the shifted one
+	float* direct_buffer;
 
 	RubberBandState pitcher;
+	VocoderVoice* vocoder;
 	SampleBuffer* pitch_buffer;
 
-	uint32_t delay_samples;
+	PitchEngine engine;
+	double pitch_scale;
+	double shift_phase;
+	float shift_window;
+
+	// Within the pitch dead zone the voice is read straight from the input
+	// history and the pitch shifter stands still. The fade goes from the
+	// shifted (0) to the direct voice (1), the shifter runs until it is
+	// through. A restarted shifter is primed over the next sub-blocks or,
+	// if it can't be, the fade waits until its output has reached the delay.
+	bool shifting;
+	bool restart;
+	uint32_t shift_wait;
+	Ramp direct_fade;
+	float direct_y1;
+
+	// A primed shifter catches up with the prime_left samples of the input
+	// history before the sub-block that it lacks, prime_chunk of them in
+	// this one. Woken up from a bypass, the voice is muted meanwhile.
+	uint32_t prime_left;
+	uint32_t prime_chunk;
+	bool prime_muted;
+
+	// the delay after the pitch shifter is fractional and moved by the
+	// modulation on top, which starts at a phase of its own for each voice
+	float* delay_curve;
+	double mod_phase;
+	float allpass_y1;
+
+	// last seen control values and what is derived from them
+	bool active;
+	// the voice has gone silent with its source and isn't processed
+	bool asleep;
+	float seen_pitch;
+	float seen_delay;
+	float seen_gain;
+	float seen_pan;
+	float delay_target;
+
+	Ramp pitch_ramp;
 
 	uint32_t latency;
+
+	// time spent in the stages of this voice during the last period
+	float* load;
+	uint64_t time_shift;
+	uint64_t time_delay;
+	float avg_load;
 } Channel;
 
+/*
+ * What the mixdown and the delays need of the voices, in arrays indexed by
+ * the voice, so that it is updated for all voices in one loop.
+ */
+typedef struct {
+	float gain[MAX_CHAN_NUM] CACHE_ALIGNED;
+	float pan_l[MAX_CHAN_NUM] CACHE_ALIGNED;
+	float pan_r[MAX_CHAN_NUM] CACHE_ALIGNED;
+	// the delay after the pitch shifter in samples
+	float delay[MAX_CHAN_NUM] CACHE_ALIGNED;
+
+	RampBank gain_l;
+	RampBank gain_r;
+	RampBank delay_ramp;
+} VoiceBank;
+
 typedef struct {
 	const float* input;
+	const float* input_r;
 	float* output_L;
 	float* output_R;
 
@@ -193,30 +608,232 @@ typedef struct {
 	const float* dry_solo;
 
 	float* latency;
+	float* reconfigurations;
 
 	const float* enabled;
-
-	float* copied_input;
-	float* retrieve_buffer;
-
-	SampleBuffer* latency_buffer;
+	const float* parallel;
+	const float* engine;
+	const float* pan_law;
+	const float* width;
+
+	const float* morph_enable;
+	const float* morph;
+	const float* store_a;
+	const float* store_b;
+
+	const float* gate_threshold;
+	const float* gate_hold;
+	float* slept;
+
+	const float* measure_load;
+	float* dsp_load;
+	float* load_shift;
+	float* load_delay;
+	float* load_mix;
+	float* latency_shifter;
+	float* latency_hidden;
+
+	bool stereo;
+	uint32_t n_sources;
+	InputSource source[HRM_N_SOURCES];
+	float* mid_input;
 
 	double rate;
 
-	Channel channel[CHAN_NUM];
+	float shift_window;
+	float shift_window_min;
+
+	const float* live;
+	const float* max_latency;
+	bool live_mode;
+	uint32_t latency_budget;
+
+	const float* interpolation;
+	const float* mod_source;
+	const float* mod_rate;
+	const float* mod_depth;
+	const float* dead_zone;
+	float dead_zone_cents;
+	float direct_fade_step;
+	const SincTable* sinc_table;
+	const ModTable* mod_table;
+	DelayInterpolation interp;
+	ModSource mod;
+	double mod_inc;
+	Ramp mod_depth_ramp;
+	bool modulating;
+
+	LV2_URID_Map* map;
+	LV2_URID urid_snapshots;
+	LV2_URID urid_chunk;
+
+	// the snapshots run() works with, what is restored for it and what it
+	// has published to be saved
+	SnapshotState snapshots;
+	SnapshotExchange restored;
+	SnapshotExchange saved;
+	uint32_t restored_seen;
+	float seen_store[N_SNAPSHOTS];
+
+	const PanTable* pan_table;
+	float seen_pan_law;
+	float seen_width;
+	PanLaw law;
+	float stereo_width;
+
+	float seen_threshold;
+	float threshold_lin;
+	uint64_t n_periods;
+	uint64_t n_periods_slept;
+	// voices processed and voices asleep in the current period
+	uint32_t n_awake;
+	uint32_t n_asleep;
+
+	float seen_dry_gain;
+	float seen_dry_pan;
+	float dry_gain_lin;
+	float dry_pan_l;
+	float dry_pan_r;
+
+	bool plan_dirty;
+	uint32_t reported_latency;
+	uint32_t shifter_latency;
+	uint32_t reconfiguration_count;
+
+	Ramp dry_gain_l;
+	Ramp dry_gain_r;
+	// 1 processed, 0 bypassed, the voices sleep once it has reached 0
+	Ramp bypass_fade;
+	float bypass_step;
+	bool bypassed;
+	bool fade_primed;
+	bool prime_voices;
+	uint32_t prime_len;
+	float max_delay;
+	float ramp_time;
+	float ramp_coeff;
+	uint32_t ramp_coeff_n;
+	bool ramps_primed;
+
+	bool measuring;
+	float load_coeff;
+	uint32_t load_coeff_n;
+	float avg_dsp;
+	float avg_shift;
+	float avg_delay;
+	float avg_mix;
+
+	// the worker threads, tables and FFT plans all instances share
+	SharedEngine* shared;
+	const VocoderPlan* vocoder_plan;
+	WorkerPool* workers;
+	// the enabled voices, only they are touched after the control update
+	Channel* jobs[MAX_CHAN_NUM];
+	uint32_t job_samples;
+
+	// the longest block processed in one go, the scratch buffers are as long
+	uint32_t block_len;
+	uint64_t time_mix;
+
+	uint32_t n_voices;
+	Channel channel[MAX_CHAN_NUM];
+	VoiceBank voices;
+	// the scratch buffers of all voices in one piece
+	float* voice_scratch;
+
+	// all the buffers the DSP works on
+	Arena arena;
 } Harmonigilo;
 
 
+static void cleanup(LV2_Handle instance);
+
+/*
+ * Carves the buffers the DSP works on from the arena. With an arena that
+ * only counts it just finds out how much memory that takes.
+ */
+static bool
+carve_dsp_memory(Harmonigilo* hrm, size_t delay_buflen)
+{
+	Arena* arena = &hrm->arena;
+
+	// the delay, direct and curve buffer of each voice, each one from a
+	// cache line on
+	const size_t line = CACHE_LINE/sizeof(float);
+	const size_t scratch_len = (hrm->block_len + line-1) & ~(line-1);
+	hrm->voice_scratch = (float*)arena_alloc(arena, VOICE_SCRATCH_BUFFERS*hrm->n_voices*scratch_len*sizeof(float));
+	bool carved = hrm->voice_scratch != NULL;
+
+	if (hrm->stereo) {
+		hrm->mid_input = (float*)arena_alloc(arena, hrm->block_len*sizeof(float));
+		carved = carved && hrm->mid_input;
+	}
+
+	for (uint32_t s=0; s<hrm->n_sources; ++s) {
+		InputSource* src = &hrm->source[s];
+		// the delay line shifter reads the input history from here, the
+		// dry signal is delayed by up to the latency of the pitch shifters
+		src->history = new_sample_buffer(arena, delay_buflen + hrm->block_len + (size_t)hrm->shift_window + 2, hrm->block_len);
+		src->analysis = new_vocoder_analysis(arena, hrm->vocoder_plan, hrm->block_len);
+		carved = carved && src->history && src->analysis;
+	}
+
+	for (uint32_t v=0; v<hrm->n_voices; ++v) {
+		Channel* ch = &hrm->channel[v];
+		ch->pitch_buffer = new_sample_buffer(arena, delay_buflen, hrm->block_len);
+		ch->vocoder = new_vocoder_voice(arena, hrm->vocoder_plan);
+		carved = carved && ch->pitch_buffer && ch->vocoder;
+		if (hrm->voice_scratch) {
+			ch->delay_buffer = hrm->voice_scratch + VOICE_SCRATCH_BUFFERS*v*scratch_len;
+			ch->direct_buffer = ch->delay_buffer + scratch_len;
+			ch->delay_curve = ch->direct_buffer + scratch_len;
+		}
+	}
+
+	return carved && !arena_counting(arena);
+}
+
+
 static LV2_Handle
 instantiate(const LV2_Descriptor* descriptor,
 	    double rate,
 	    const char* bundle_path,
 	    const LV2_Feature* const* features)
 {
-	Harmonigilo* hrm = (Harmonigilo*)malloc(sizeof(Harmonigilo));
-	hrm->copied_input = (float*)malloc(BUFLEN*sizeof(float));
-	hrm->retrieve_buffer = (float*)malloc(BUFLEN*sizeof(float));
-	const size_t delay_buflen = (size_t) rint (rate * MAXDELAY / 1000.0);
+	// the arrays of the voice bank start at cache lines
+	Harmonigilo* hrm = (Harmonigilo*)cache_aligned_alloc(sizeof(Harmonigilo));
+	if (!hrm) {
+		return NULL;
+	}
+	// cleanup() can take what is set up so far if anything fails
+	memset(hrm, 0, sizeof(Harmonigilo));
+	init_arena(&hrm->arena);
+
+	const LV2_Options_Option* options = NULL;
+	hrm->map = NULL;
+	for (uint32_t i=0; features && features[i]; ++i) {
+		if (!strcmp(features[i]->URI, LV2_URID__map)) {
+			hrm->map = (LV2_URID_Map*)features[i]->data;
+		} else if (!strcmp(features[i]->URI, LV2_OPTIONS__options)) {
+			options = (const LV2_Options_Option*)features[i]->data;
+		}
+	}
+
+	hrm->block_len = SUB_BLOCK_LEN;
+	if (hrm->map && options) {
+		const LV2_URID max_block = hrm->map->map(hrm->map->handle, LV2_BUF_SIZE__maxBlockLength);
+		const LV2_URID atom_int = hrm->map->map(hrm->map->handle, LV2_ATOM__Int);
+		for (const LV2_Options_Option* o = options; o->key; ++o) {
+			if (o->key == max_block && o->type == atom_int && *(const int32_t*)o->value > 0) {
+				hrm->block_len = MIN(SUB_BLOCK_LEN, (uint32_t) *(const int32_t*)o->value);
+			}
+		}
+	}
+
+	hrm->n_voices = hrm_variant_voices(descriptor->URI);
+	hrm->stereo = hrm_variant_stereo(descriptor->URI);
+	hrm->max_delay = hrm_variant_max_delay(descriptor->URI);
+	const size_t delay_buflen = (size_t) rint (rate * (hrm->max_delay + MOD_DEPTH_MAX_MS + DELAY_HEADROOM_MS) / 1000.0);
 
 	enum RubberBandOption pitch_opt =
 		RubberBandOptionProcessRealTime |
@@ -225,15 +842,71 @@ instantiate(const LV2_Descriptor* descriptor,
  		RubberBandOptionTransientsSmooth |
 		RubberBandOptionWindowStandard;
 
+	hrm->shift_window = (float) rint(rate * SHIFT_WINDOW_MS / 1000.0);
+	hrm->shift_window_min = (float) rint(rate * SHIFT_WINDOW_MIN_MS / 1000.0);
+
+	// the stereo variant has left, right and mid, the mono ones just the input
+	hrm->n_sources = hrm->stereo ? HRM_N_SOURCES : 1;
+
+	hrm->shared = acquire_shared_engine();
+	if (!hrm->shared) {
+		cleanup((LV2_Handle)hrm);
+		return NULL;
+	}
+	hrm->vocoder_plan = acquire_vocoder_plan(hrm->shared, vocoder_frame_size(rate));
+	if (!hrm->vocoder_plan) {
+		cleanup((LV2_Handle)hrm);
+		return NULL;
+	}
+	hrm->workers = hrm->shared->workers;
+	hrm->pan_table = &hrm->shared->pan_table;
+	hrm->sinc_table = &hrm->shared->sinc_table;
+	hrm->mod_table = &hrm->shared->mod_table;
+
+	// the first pass only counts the memory
+	carve_dsp_memory(hrm, delay_buflen);
+	if (!arena_reserve(&hrm->arena) || !carve_dsp_memory(hrm, delay_buflen)) {
+		cleanup((LV2_Handle)hrm);
+		return NULL;
+	}
+	hrm->source[HRM_SOURCE_MID].data = hrm->mid_input;
+
 	uint32_t rate_i = (uint32_t) rint(rate);
-	for (Channel* ch = hrm->channel; ch < hrm->channel+CHAN_NUM; ++ch) {
-		ch->pitch_buffer = new_sample_buffer(delay_buflen);
+	for (Channel* ch = hrm->channel; ch < hrm->channel+hrm->n_voices; ++ch) {
+		ch->source = &hrm->source[HRM_SOURCE_LEFT];
+		ch->voice = ch - hrm->channel;
 		ch->pitcher = rubberband_new(rate_i, 1, pitch_opt, 1.0, 1.0);
-		ch->delay_buffer = (float*)malloc(BUFLEN*sizeof(float));
+		if (!ch->pitcher) {
+			cleanup((LV2_Handle)hrm);
+			return NULL;
+		}
+		ch->engine = HRM_ENGINE_RUBBERBAND;
+		ch->pitch_scale = 1.0;
+		ch->shift_phase = 0.0;
+		ch->shift_window = hrm->shift_window;
 	}
-	hrm->latency_buffer = new_sample_buffer(BUFLEN);
 	hrm->rate = rate;
 
+	hrm->ramp_time = rate * RAMP_TIME_MS / 1000.0;
+	hrm->bypass_step = 1000.0 / (rate * BYPASS_FADE_MS);
+	hrm->direct_fade_step = 1000.0 / (rate * DIRECT_FADE_MS);
+	// the delays can't reach further back than this into the pitch buffers
+	hrm->prime_len = delay_buflen - hrm->block_len;
+	hrm->ramp_coeff_n = 0;
+	hrm->ramps_primed = false;
+
+	hrm->load_coeff_n = 0;
+
+	if (hrm->map) {
+		hrm->urid_snapshots = hrm->map->map(hrm->map->handle, HRM_URI "snapshots");
+		hrm->urid_chunk = hrm->map->map(hrm->map->handle, LV2_ATOM__Chunk);
+	}
+	memset(&hrm->snapshots, 0, sizeof(SnapshotState));
+	memset(&hrm->restored, 0, sizeof(SnapshotExchange));
+	memset(&hrm->saved, 0, sizeof(SnapshotExchange));
+	hrm->restored_seen = 0;
+	hrm->seen_store[SNAPSHOT_A] = hrm->seen_store[SNAPSHOT_B] = 0.f;
+
 	return (LV2_Handle)hrm;
 }
 
@@ -244,9 +917,9 @@ connect_port(LV2_Handle instance,
 {
 	Harmonigilo* hrm = (Harmonigilo*)instance;
 
-	if (port < CHAN_NUM*7) {
-		Channel* ch = &hrm->channel[port/7];
-		switch (port % 7) {
+	if (port < HRM_VOICE_PORTS*hrm->n_voices) {
+		Channel* ch = &hrm->channel[port/HRM_VOICE_PORTS];
+		switch ((VoicePortIndex)(port % HRM_VOICE_PORTS)) {
 		case HRM_ENABLED_0:
 			ch->enabled = (const float*)data;
 			break;
@@ -274,6 +947,22 @@ connect_port(LV2_Handle instance,
 		return;
 	}
 
+	if (hrm->stereo && port == hrm_input_r_port(hrm->n_voices)) {
+		hrm->input_r = (const float*)data;
+		return;
+	}
+	if (hrm->stereo && port > hrm_input_r_port(hrm->n_voices)) {
+		hrm->channel[port-hrm_source_port(hrm->n_voices, 0)].source_sel = (const float*)data;
+		return;
+	}
+
+	port -= HRM_VOICE_PORTS*hrm->n_voices;
+
+	if (port >= HRM_VOICE_LOAD_0 && port < HRM_VOICE_LOAD_0+hrm->n_voices) {
+		hrm->channel[port-HRM_VOICE_LOAD_0].load = (float*)data;
+		return;
+	}
+
 	switch ((PortIndex)port) {
 	case HRM_DRY_PAN:
 		hrm->dry_pan = (const float*)data;
@@ -302,31 +991,240 @@ connect_port(LV2_Handle instance,
 	case HRM_OUTPUT_R:
 		hrm->output_R = (float*)data;
 		break;
+	case HRM_PARALLEL:
+		hrm->parallel = (const float*)data;
+		break;
+	case HRM_ENGINE:
+		hrm->engine = (const float*)data;
+		break;
+	case HRM_RECONFIGURATIONS:
+		hrm->reconfigurations = (float*)data;
+		break;
+	case HRM_MEASURE_LOAD:
+		hrm->measure_load = (const float*)data;
+		break;
+	case HRM_DSP_LOAD:
+		hrm->dsp_load = (float*)data;
+		break;
+	case HRM_LOAD_SHIFT:
+		hrm->load_shift = (float*)data;
+		break;
+	case HRM_LOAD_DELAY:
+		hrm->load_delay = (float*)data;
+		break;
+	case HRM_LOAD_MIX:
+		hrm->load_mix = (float*)data;
+		break;
+	case HRM_LATENCY_SHIFTER:
+		hrm->latency_shifter = (float*)data;
+		break;
+	case HRM_LATENCY_HIDDEN:
+		hrm->latency_hidden = (float*)data;
+		break;
+	case HRM_PAN_LAW:
+		hrm->pan_law = (const float*)data;
+		break;
+	case HRM_WIDTH:
+		hrm->width = (const float*)data;
+		break;
+	case HRM_MORPH_ENABLE:
+		hrm->morph_enable = (const float*)data;
+		break;
+	case HRM_MORPH:
+		hrm->morph = (const float*)data;
+		break;
+	case HRM_STORE_A:
+		hrm->store_a = (const float*)data;
+		break;
+	case HRM_STORE_B:
+		hrm->store_b = (const float*)data;
+		break;
+	case HRM_LIVE:
+		hrm->live = (const float*)data;
+		break;
+	case HRM_MAX_LATENCY:
+		hrm->max_latency = (const float*)data;
+		break;
+	case HRM_INTERPOLATION:
+		hrm->interpolation = (const float*)data;
+		break;
+	case HRM_MOD_SOURCE:
+		hrm->mod_source = (const float*)data;
+		break;
+	case HRM_MOD_RATE:
+		hrm->mod_rate = (const float*)data;
+		break;
+	case HRM_MOD_DEPTH:
+		hrm->mod_depth = (const float*)data;
+		break;
+	case HRM_DEAD_ZONE:
+		hrm->dead_zone = (const float*)data;
+		break;
+	case HRM_GATE_THRESHOLD:
+		hrm->gate_threshold = (const float*)data;
+		break;
+	case HRM_GATE_HOLD:
+		hrm->gate_hold = (const float*)data;
+		break;
+	case HRM_SLEPT:
+		hrm->slept = (float*)data;
+		break;
 	default:
 		assert(0);
 	}
 }
 
 
+static void
+reset_channel(Harmonigilo* hrm, Channel* ch)
+{
+	reset_sample_buffer(ch->pitch_buffer);
+	rubberband_reset(ch->pitcher);
+	reset_vocoder_voice(ch->source->analysis, ch->vocoder);
+	ch->shift_phase = 0.0;
+	ch->seen_pitch = NAN;
+
+	if (ch->engine == HRM_ENGINE_VOCODER) {
+		// the vocoder emits a hop whenever a frame is complete, one hop
+		// of head start keeps it ahead of the reads within a block
+		ch->pitch_buffer->write_pos = ch->source->analysis->hop;
+	}
+}
+
 static void
 activate(LV2_Handle instance)
 {
 	Harmonigilo* hrm = (Harmonigilo*)instance;
-	printf("Activate called\n");
-	bzero(hrm->copied_input, BUFLEN*sizeof(float));
-	bzero(hrm->retrieve_buffer, BUFLEN*sizeof(float));
-	for (Channel* ch = hrm->channel; ch < hrm->channel+CHAN_NUM; ++ch) {
-		reset_sample_buffer(ch->pitch_buffer);
+	for (Channel* ch = hrm->channel; ch < hrm->channel+hrm->n_voices; ++ch) {
+		reset_channel(hrm, ch);
+		ch->active = false;
+		ch->asleep = false;
+		// the voices are spread over the cycle of the modulation
+		ch->mod_phase = (double)MOD_TABLE_SIZE * (ch - hrm->channel) / hrm->n_voices;
+		ch->allpass_y1 = 0.f;
+		ch->shifting = true;
+		ch->restart = false;
+		ch->shift_wait = 0;
+		ch->prime_left = 0;
+		ch->prime_muted = false;
+		snap_ramp(&ch->direct_fade, 0.f);
+		ch->direct_y1 = 0.f;
+		ch->seen_delay = ch->seen_gain = ch->seen_pan = NAN;
+		ch->avg_load = 0.f;
+	}
+	hrm->seen_dry_gain = hrm->seen_dry_pan = NAN;
+	hrm->seen_pan_law = hrm->seen_width = NAN;
+	hrm->plan_dirty = true;
+	hrm->reported_latency = 0;
+	hrm->reconfiguration_count = 0;
+	for (uint32_t s=0; s<hrm->n_sources; ++s) {
+		reset_sample_buffer(hrm->source[s].history);
+		reset_vocoder_analysis(hrm->source[s].analysis);
+		hrm->source[s].analysis_active = false;
+		hrm->source[s].quiet = 0;
 	}
-	reset_sample_buffer(hrm->latency_buffer);
+	hrm->seen_threshold = NAN;
+	hrm->mod = HRM_MOD_OFF;
+	hrm->n_periods = hrm->n_periods_slept = 0;
+	hrm->ramps_primed = false;
+	snap_ramp(&hrm->bypass_fade, 0.f);
+	hrm->bypassed = false;
+	hrm->prime_voices = false;
+	hrm->fade_primed = false;
+	hrm->measuring = false;
+	hrm->avg_dsp = hrm->avg_shift = hrm->avg_delay = hrm->avg_mix = 0.f;
 }
 
+/*
+ * Lightweight pitch shifter for small shifts: two taps read the input
+ * history from the latency buffer with a delay sweeping through the shift
+ * window. The sweep speed (1 - pitch_scale) results in the pitch shift.
+ * The taps are half a window apart and crossfaded by triangular windows,
+ * so that each tap is silent while its delay jumps back.
+ */
 static void
-pitch_shift(Harmonigilo* hrm, Channel* ch, uint32_t n_samples)
+delayline_shift(Harmonigilo* hrm, Channel* ch, uint32_t n_samples, uint32_t lag)
+{
+	const SampleBuffer* in = ch->source->history;
+	const float window = ch->shift_window;
+	const double inc = (1.0 - ch->pitch_scale) / window;
+
+	// the n_samples before the last lag samples of the history are shifted
+	long pos = (long)in->write_pos - (long)(n_samples + lag);
+	if (pos < 0) {
+		pos += in->len;
+	}
+
+	double phase = ch->shift_phase;
+
+	// written straight into the pitch buffer, in two goes if it wraps
+	while (n_samples > 0) {
+		size_t space;
+		float* out = get_write_span_of_sample_buffer(ch->pitch_buffer, &space);
+		const uint32_t n = MIN(n_samples, space);
+
+		for (uint32_t i=0; i<n; ++i) {
+			double phase2 = phase + 0.5;
+			if (phase2 >= 1.0) {
+				phase2 -= 1.0;
+			}
+			const float w = phase < 0.5 ? 2.f*phase : 2.f*(1.f-phase);
+			const float s1 = get_frac_sample_from_sample_buffer(in, pos, SHIFT_MIN_DELAY + phase*window);
+			const float s2 = get_frac_sample_from_sample_buffer(in, pos, SHIFT_MIN_DELAY + phase2*window);
+			out[i] = w*s1 + (1.f-w)*s2;
+
+			phase += inc;
+			if (phase >= 1.0) {
+				phase -= 1.0;
+			} else if (phase < 0.0) {
+				phase += 1.0;
+			}
+			if (++pos == (long)in->len) {
+				pos = 0;
+			}
+		}
+
+		sample_buffer_advance_write_pos(ch->pitch_buffer, n);
+		n_samples -= n;
+	}
+
+	ch->shift_phase = phase;
+}
+
+/* resynthesis of the frames the shared analysis stage has found in this block */
+static void
+vocoder_shift(Harmonigilo* hrm, Channel* ch)
+{
+	const VocoderAnalysis* va = ch->source->analysis;
+	for (uint32_t f=0; f<va->n_frames; ++f) {
+		const float* out = vocoder_synthesize(va, ch->vocoder, f, ch->pitch_scale);
+		put_to_sample_buffer(ch->pitch_buffer, out, va->hop);
+	}
+}
+
+/* RubberBand's output is retrieved straight into the pitch buffer, in two
+ * goes if it wraps */
+static void
+rubberband_retrieve_to_sample_buffer(RubberBandState pitcher, SampleBuffer* sb, uint32_t avail)
+{
+	while (avail > 0) {
+		size_t space;
+		float* dst = get_write_span_of_sample_buffer(sb, &space);
+		const uint32_t retrieved = rubberband_retrieve(pitcher, &dst, MIN(avail, space));
+		if (retrieved == 0) {
+			break;
+		}
+		sample_buffer_advance_write_pos(sb, retrieved);
+		avail -= retrieved;
+	}
+}
+
+static void
+rubberband_shift(Harmonigilo* hrm, Channel* ch, const float* data, uint32_t n_samples)
 {
 	uint32_t processed = 0;
 
-	const float* proc_ptr = hrm->copied_input;
+	const float* proc_ptr = data;
 
 	while (processed < n_samples) {
 		uint32_t in_chunk_size = rubberband_get_samples_required(ch->pitcher);
@@ -341,108 +1239,1111 @@ pitch_shift(Harmonigilo* hrm, Channel* ch, uint32_t n_samples)
 		processed += in_chunk_size;
 		proc_ptr += in_chunk_size;
 
-		const uint32_t avail = rubberband_available(ch->pitcher);
-		const uint32_t out_chunk_size = rubberband_retrieve(ch->pitcher, &(hrm->retrieve_buffer), avail);
-		put_to_sample_buffer(ch->pitch_buffer, hrm->retrieve_buffer, out_chunk_size);
+		rubberband_retrieve_to_sample_buffer(ch->pitcher, ch->pitch_buffer, rubberband_available(ch->pitcher));
 	}
 }
 
 static void
-run(LV2_Handle instance, uint32_t n_samples)
+pitch_shift(Harmonigilo* hrm, Channel* ch, uint32_t n_samples)
 {
-	assert (n_samples <= 8192);
+	switch (ch->engine) {
+	case HRM_ENGINE_DELAYLINE:
+		delayline_shift(hrm, ch, n_samples, 0);
+		break;
+	case HRM_ENGINE_VOCODER:
+		vocoder_shift(hrm, ch);
+		break;
+	case HRM_ENGINE_RUBBERBAND:
+	default:
+		rubberband_shift(hrm, ch, ch->source->data, n_samples);
+		break;
+	}
+}
 
-	Harmonigilo* hrm = (Harmonigilo*)instance;
+/*
+ * Fills the pitch buffer of a flushed voice with len samples of the shifted
+ * input history before the last lag samples. So the voice sets in right
+ * away instead of after its delay. The vocoder's analysis can't go back,
+ * its voices aren't primed.
+ */
+static void
+prime_channel(Harmonigilo* hrm, Channel* ch, uint32_t len, uint32_t lag)
+{
+	SampleBuffer* pb = ch->pitch_buffer;
 
-	if (*hrm->enabled <= 0) {
-		float in = 0.f;
-		for (uint32_t i=0; i<n_samples; ++i) {
-			in = hrm->input[i] * 0.86070797642505780723; // -3db exp(-3.f/20.f*log(10.f))
-			hrm->output_L[i] = in;
-			hrm->output_R[i] = in;
+	switch (ch->engine) {
+	case HRM_ENGINE_DELAYLINE:
+		delayline_shift(hrm, ch, len, lag);
+		break;
+	case HRM_ENGINE_RUBBERBAND:
+	default:
+		for (uint32_t done=0; done<len; done+=hrm->block_len) {
+			const uint32_t n = MIN(hrm->block_len, len-done);
+			rubberband_shift(hrm, ch, get_past_span_of_sample_buffer(ch->source->history, lag+len-done-n, n), n);
 		}
-		return;
+		break;
 	}
 
-	memcpy (hrm->copied_input, hrm->input, n_samples*sizeof(float));
-	put_to_sample_buffer(hrm->latency_buffer, hrm->copied_input, n_samples);
-
-	uint32_t min_delay = MAXDELAY*hrm->rate/1000.0;
-	uint32_t max_latency = 0;
+	// what has been written so far is the past of the voice
+	pb->read_pos = pb->write_pos;
+}
 
-	bool solo = false;
-	if (*hrm->dry_solo > 0.5) {
-		solo = true;
-	}
+/*
+ * Shifts the next prime_chunk samples of the history a primed voice lacks,
+ * the sub-block itself is added to what it lacks until it is through. True
+ * once it is, then the sub-block is shifted as usual.
+ */
+static bool
+catch_up_channel(Harmonigilo* hrm, Channel* ch, uint32_t n_samples)
+{
+	if (ch->engine == HRM_ENGINE_VOCODER) {
+		// switched over meanwhile, it starts over like with any switch
+		ch->prime_left = 0;
+		return true;
+	}
+	const uint32_t len = ch->prime_chunk;
+	if (len > 0) {
+		prime_channel(hrm, ch, len, n_samples + ch->prime_left - len);
+		ch->prime_left -= len;
+	}
+	if (ch->prime_left > 0) {
+		ch->prime_left += n_samples;
+		return false;
+	}
+	return true;
+}
 
-	for (Channel* ch = hrm->channel; ch < hrm->channel+CHAN_NUM; ++ch) {
-		if (*ch->enabled < 0.5) {
+/* how far back the delays of the voices to be processed reach, with their
+ * modulation and the lag of the pitch shifters, so the voices of the long
+ * delay variant only prime the seconds they use */
+static uint32_t
+get_prime_len(const Harmonigilo* hrm, Channel* const* jobs, uint32_t n_jobs)
+{
+	float reach = 0.f;
+	for (uint32_t j=0; j<n_jobs; ++j) {
+		const uint32_t v = jobs[j]->voice;
+		reach = fmaxf(reach, fmaxf(hrm->voices.delay[v], hrm->voices.delay_ramp.current[v]));
+	}
+	reach += hrm->shifter_latency + MOD_DEPTH_MAX_MS * hrm->rate / 1000.0 + INTERP_MIN_DELAY;
+	return MIN(hrm->prime_len, (uint32_t)ceilf(reach) + hrm->block_len);
+}
+
+/*
+ * A flushed voice is primed with the history up to this sub-block while it
+ * is processed over the next ones. The vocoder's analysis can't go back,
+ * its voices wait for their output instead. Meanwhile the voice is muted
+ * or it plays the direct voice.
+ */
+static void
+start_priming(Harmonigilo* hrm, Channel* ch, bool muted)
+{
+	if (ch->engine == HRM_ENGINE_VOCODER) {
+		ch->shift_wait = ch->latency + (uint32_t) ceilf(fmaxf(hrm->voices.delay[ch->voice], 0.f) + hrm->mod_depth_ramp.current);
+	} else {
+		ch->prime_left = get_prime_len(hrm, &ch, 1);
+	}
+	ch->prime_muted = muted;
+}
+
+static void
+set_engine(Harmonigilo* hrm, Channel* ch, PitchEngine engine)
+{
+	if (ch->engine == engine) {
+		return;
+	}
+	// the engines differ in how far their output lags behind, so start over
+	ch->engine = engine;
+	reset_channel(hrm, ch);
+}
+
+static void
+set_source(Harmonigilo* hrm, Channel* ch, InputSource* source)
+{
+	if (ch->source == source) {
+		return;
+	}
+	// whatever the pitch shifter holds is from the other source
+	ch->source = source;
+	reset_channel(hrm, ch);
+}
+
+/*
+ * Takes over a restored state and stores the controls of the voices as
+ * snapshot A or B when asked to. A snapshot that has never been stored is
+ * taken from the controls as soon as the morph is switched on. Every
+ * change is published to be saved.
+ */
+static void
+update_snapshots(Harmonigilo* hrm)
+{
+	// a read that runs into restore() fails, but leaves what it has copied
+	// so far, so the snapshots in use are only replaced by a complete one
+	SnapshotState restored;
+	bool changed = snapshot_exchange_read(&hrm->restored, &restored, &hrm->restored_seen);
+	if (changed) {
+		memcpy(&hrm->snapshots, &restored, sizeof(SnapshotState));
+	}
+
+	const float* store[N_SNAPSHOTS] = { hrm->store_a, hrm->store_b };
+	for (uint32_t s=0; s<N_SNAPSHOTS; ++s) {
+		const bool trigger = *store[s] > 0.5 && hrm->seen_store[s] <= 0.5;
+		hrm->seen_store[s] = *store[s];
+		if (!trigger && (hrm->snapshots.stored[s] || *hrm->morph_enable <= 0.5)) {
 			continue;
 		}
-		rubberband_set_pitch_scale(ch->pitcher, pow(2.0, (*ch->pitch)/1200));
+		for (uint32_t v=0; v<hrm->n_voices; ++v) {
+			const Channel* ch = &hrm->channel[v];
+			VoiceSetup* vs = &hrm->snapshots.voice[s][v];
+			vs->delay = *ch->delay;
+			vs->pitch = *ch->pitch;
+			vs->pan = *ch->pan;
+			vs->gain = *ch->gain;
+		}
+		hrm->snapshots.stored[s] = 1;
+		changed = true;
+	}
+
+	if (changed) {
+		hrm->snapshots.version = SNAPSHOT_STATE_VERSION;
+		hrm->snapshots.n_voices = hrm->n_voices;
+		snapshot_exchange_write(&hrm->saved, &hrm->snapshots);
+	}
+}
+
+/* the controls of the voice, or their morph between the snapshots */
+static void
+get_voice_setup(const Harmonigilo* hrm, const Channel* ch, VoiceSetup* vs)
+{
+	if (*hrm->morph_enable <= 0.5) {
+		vs->delay = *ch->delay;
+		vs->pitch = *ch->pitch;
+		vs->pan = *ch->pan;
+		vs->gain = *ch->gain;
+		return;
+	}
+	const uint32_t v = ch - hrm->channel;
+	morph_voice_setup(&hrm->snapshots.voice[SNAPSHOT_A][v], &hrm->snapshots.voice[SNAPSHOT_B][v],
+			  fminf(fmaxf(*hrm->morph, 0.f), 1.f), vs);
+}
 
-		ch->latency = 2*rubberband_get_latency(ch->pitcher);
-		ch->delay_samples = (uint32_t) rint((*ch->delay)*hrm->rate/1000.0);
+static uint32_t
+delayline_latency(float window)
+{
+	return (uint32_t) rint(SHIFT_MIN_DELAY + window/2.f);
+}
 
-		if (ch->delay_samples < min_delay) {
-			min_delay = ch->delay_samples;
+/*
+ * Live mode: a voice keeps the preferred engine if its latency fits into
+ * the voice's delay plus the latency budget. Otherwise it steps down to
+ * the vocoder and then to the delay line shifter, whose window shrinks to
+ * fit if need be. The window is only shortened in live mode.
+ */
+static PitchEngine
+fit_engine(Harmonigilo* hrm, Channel* ch, PitchEngine preferred, uint32_t budget, float* window)
+{
+	*window = hrm->shift_window;
+	switch (preferred) {
+	case HRM_ENGINE_RUBBERBAND:
+		if (2*rubberband_get_latency(ch->pitcher) <= budget) {
+			return HRM_ENGINE_RUBBERBAND;
+		}
+		// fall through
+	case HRM_ENGINE_VOCODER:
+		if (vocoder_latency(ch->source->analysis) <= budget) {
+			return HRM_ENGINE_VOCODER;
 		}
+		// fall through
+	case HRM_ENGINE_DELAYLINE:
+	default:
+		break;
+	}
+	// the delay of the taps sweeps through the window, half of it on average
+	const float fit = 2.f * ((float)budget - SHIFT_MIN_DELAY);
+	*window = fminf(hrm->shift_window, fmaxf(hrm->shift_window_min, fit));
+	return HRM_ENGINE_DELAYLINE;
+}
 
-		if (ch->latency > max_latency) {
-			max_latency = ch-> latency;
+/*
+ * Follows the setup of an enabled voice. Derived values like the pitch
+ * scale or the linear gain are only recomputed if the setup has actually
+ * changed. Returns true if the latency plan needs to be redone.
+ */
+static bool
+update_channel(Harmonigilo* hrm, Channel* ch, const VoiceSetup* setup, PitchEngine engine, float ramp_coeff, bool prime, uint32_t n_samples)
+{
+	bool replan = false;
+
+	if (!ch->active) {
+		ch->active = true;
+		replan = true;
+	}
+
+	if (hrm->stereo) {
+		VoiceSource source = HRM_SOURCE_MID;
+		if (*ch->source_sel < 0.5) {
+			source = HRM_SOURCE_LEFT;
+		} else if (*ch->source_sel < 1.5) {
+			source = HRM_SOURCE_RIGHT;
+		}
+		if (ch->source != &hrm->source[source]) {
+			set_source(hrm, ch, &hrm->source[source]);
+			replan = true;
 		}
+	}
 
-		if (*ch->solo > 0.5) {
-			solo = true;
+	if (setup->delay != ch->seen_delay) {
+		ch->seen_delay = setup->delay;
+		ch->delay_target = fminf(fmaxf(setup->delay, 0.f), hrm->max_delay)*hrm->rate/1000.0;
+		replan = true;
+	}
+
+	float window = hrm->shift_window;
+	if (hrm->live_mode) {
+		engine = fit_engine(hrm, ch, engine, (uint32_t)ch->delay_target + hrm->latency_budget, &window);
+	}
+
+	if (ch->engine != engine) {
+		set_engine(hrm, ch, engine);
+		replan = true;
+	}
+
+	if (window != ch->shift_window) {
+		ch->shift_window = window;
+		// the latency is redone with the pitch
+		ch->seen_pitch = NAN;
+	}
+
+	if (prime) {
+		snap_ramp(&ch->pitch_ramp, setup->pitch);
+	} else {
+		ramp_run(&ch->pitch_ramp, setup->pitch, ramp_coeff, n_samples);
+	}
+
+	if (ch->pitch_ramp.current != ch->seen_pitch) {
+		ch->seen_pitch = ch->pitch_ramp.current;
+		ch->pitch_scale = cents_to_ratio(ch->seen_pitch);
+
+		uint32_t latency;
+		switch (ch->engine) {
+		case HRM_ENGINE_DELAYLINE:
+			latency = delayline_latency(ch->shift_window);
+			break;
+		case HRM_ENGINE_VOCODER:
+			latency = vocoder_latency(ch->source->analysis);
+			break;
+		case HRM_ENGINE_RUBBERBAND:
+		default:
+			rubberband_set_pitch_scale(ch->pitcher, ch->pitch_scale);
+			latency = 2*rubberband_get_latency(ch->pitcher);
+			break;
 		}
+		if (latency != ch->latency) {
+			ch->latency = latency;
+			replan = true;
+		}
+		++hrm->reconfiguration_count;
 	}
 
-	uint32_t latency_correction;
-	if (min_delay >= max_latency) {
-		latency_correction = min_delay - max_latency;
-		*hrm->latency = 0;
+	// the shifter stops once the fade to the direct voice is through and
+	// starts over as soon as the pitch leaves the dead zone
+	const bool in_dead_zone = fabsf(ch->pitch_ramp.current) <= hrm->dead_zone_cents;
+	if (!ch->shifting && !in_dead_zone) {
+		ch->shifting = true;
+		ch->restart = true;
+		replan = true;
+	}
+	float direct = in_dead_zone ? 1.f : 0.f;
+	if ((ch->restart || ch->shift_wait > 0 || ch->prime_left > 0) && !ch->prime_muted) {
+		// there's nothing to fade over to yet
+		direct = 1.f;
+	}
+	ch->shift_wait -= MIN(ch->shift_wait, n_samples);
+	if (ch->shift_wait == 0 && ch->prime_left == 0) {
+		ch->prime_muted = false;
+	}
+	if (prime) {
+		snap_ramp(&ch->direct_fade, direct);
 	} else {
-		latency_correction = min_delay;
-		*hrm->latency = max_latency - min_delay;
+		ramp_run_linear(&ch->direct_fade, direct, hrm->direct_fade_step, n_samples);
+	}
+	if (in_dead_zone && ch->shifting && ch->direct_fade.start == 1.f && !ramp_active(&ch->direct_fade)) {
+		ch->shifting = false;
+		ch->shift_wait = 0;
+		ch->prime_left = 0;
+		ch->prime_muted = false;
+		replan = true;
 	}
 
-	for (Channel* ch = hrm->channel; ch < hrm->channel+CHAN_NUM; ++ch) {
-		if (*ch->enabled < 0.5) {
+	if (setup->gain != ch->seen_gain) {
+		ch->seen_gain = setup->gain;
+		hrm->voices.gain[ch->voice] = from_dB(ch->seen_gain);
+		++hrm->reconfiguration_count;
+	}
+
+	if (setup->pan != ch->seen_pan) {
+		ch->seen_pan = setup->pan;
+		// the width narrows the voices towards the centre
+		const float pan = 0.5f + (ch->seen_pan - 0.5f) * hrm->stereo_width;
+		pan_gains(hrm->pan_table, hrm->law, pan, &hrm->voices.pan_l[ch->voice], &hrm->voices.pan_r[ch->voice]);
+		++hrm->reconfiguration_count;
+	}
+
+	return replan;
+}
+
+/*
+ * Each voice's delay has to cover the latency of its own pitch shifter.
+ * What the voice with the least headroom can't cover is reported as
+ * latency of the plugin, by which the dry signal and the other voices are
+ * delayed. So nothing is reported as long as every delay covers its
+ * latency. The voices whose shifter stands still have no latency, they
+ * read the input history that much further back.
+ */
+static void
+plan_latency(Harmonigilo* hrm)
+{
+	uint32_t reported = 0;
+	uint32_t max_latency = 0;
+
+	for (Channel* ch = hrm->channel; ch < hrm->channel+hrm->n_voices; ++ch) {
+		if (!ch->active) {
 			continue;
 		}
-		ch->delay_samples -= latency_correction;
+		const uint32_t latency = ch->shifting ? ch->latency : 0;
+		const float uncovered = latency - ch->delay_target;
+		if (uncovered > reported) {
+			reported = (uint32_t) ceilf(uncovered);
+		}
+		if (latency > max_latency) {
+			max_latency = latency;
+		}
+	}
+
+	hrm->reported_latency = reported;
+	hrm->shifter_latency = max_latency;
+
+	for (Channel* ch = hrm->channel; ch < hrm->channel+hrm->n_voices; ++ch) {
+		if (ch->active) {
+			// with mixed engines a long delay may not fit the pitch buffer
+			// any more on top of the reported latency
+			hrm->voices.delay[ch->voice] = fminf(ch->delay_target + reported - ch->latency, hrm->prime_len);
+		}
+	}
+
+	++hrm->reconfiguration_count;
+}
+
+/* the cached decay of the one-pole ramps over a block of n_samples */
+static float
+get_ramp_coeff(Harmonigilo* hrm, uint32_t n_samples)
+{
+	if (n_samples != hrm->ramp_coeff_n) {
+		hrm->ramp_coeff = expf(-(float)n_samples / hrm->ramp_time);
+		hrm->ramp_coeff_n = n_samples;
+	}
+	return hrm->ramp_coeff;
+}
+
+/* the cached smoothing coefficient of the load averages for a block of n_samples */
+static float
+get_load_coeff(Harmonigilo* hrm, uint32_t n_samples)
+{
+	if (n_samples != hrm->load_coeff_n) {
+		hrm->load_coeff = 1.f - expf(-(float)n_samples / (hrm->rate * LOAD_TIME_MS / 1000.0));
+		hrm->load_coeff_n = n_samples;
+	}
+	return hrm->load_coeff;
+}
+
+/*
+ * Leaves the delayed voice in ch->out. Usually this points right into the
+ * pitch buffer or, within the pitch dead zone, into the input history.
+ * Only a moving or fractional delay, a voice that isn't fully written yet
+ * or the crossfade between both is fetched into the scratch buffers.
+ */
+static void
+delay_channel(Harmonigilo* hrm, Channel* ch, uint32_t n_samples)
+{
+	const RampBank* dr = &hrm->voices.delay_ramp;
+	const uint32_t v = ch->voice;
+	const Ramp* fade = &ch->direct_fade;
+	// a shifter that is still being primed has nothing to give yet
+	const bool ready = ch->shifting && ch->prime_left == 0;
+	const bool direct = !ready || fade->start > 0.f || ramp_active(fade);
+	// the direct voice goes by the write position, the block has just been
+	// written there. The read position of the mid history stands still,
+	// nothing takes a dry signal from it.
+	const SampleBuffer* history = ch->source->history;
+	long block_start = (long)history->write_pos - (long)n_samples;
+	if (block_start < 0) {
+		block_start += history->len;
+	}
+	const float* direct_out = NULL;
+
+	if (!hrm->modulating && !ramp_bank_active(dr, v) && dr->current[v] == floorf(dr->current[v])) {
+		const int rel_pos = -(int)dr->current[v];
+		if (ready) {
+			if (sample_buffer_span_written(ch->pitch_buffer, rel_pos, n_samples)) {
+				ch->out = get_span_from_sample_buffer(ch->pitch_buffer, rel_pos, n_samples);
+			} else {
+				get_from_sample_buffer(ch->pitch_buffer, rel_pos, ch->delay_buffer, n_samples);
+				ch->out = ch->delay_buffer;
+			}
+			ch->allpass_y1 = ch->out[n_samples-1];
+		}
+		if (direct) {
+			const int lag = MIN(MAX(ch->latency - rel_pos, 0), (int)hrm->prime_len);
+			direct_out = get_past_span_of_sample_buffer(history, lag, n_samples);
+			ch->direct_y1 = direct_out[n_samples-1];
+		}
+	} else {
+		float* d = ch->delay_curve;
+		for (uint32_t i=0; i<n_samples; ++i) {
+			d[i] = dr->start[v] + dr->step[v]*i;
+		}
+		if (hrm->modulating) {
+			const Ramp* depth = &hrm->mod_depth_ramp;
+			mod_table_add(hrm->mod_table, hrm->mod, &ch->mod_phase, hrm->mod_inc, depth->start, depth->step, d, n_samples);
+		}
+		const float max_delay = (float)(hrm->prime_len - INTERP_MIN_DELAY);
+		if (ready) {
+			for (uint32_t i=0; i<n_samples; ++i) {
+				d[i] = fminf(fmaxf(d[i], (float)INTERP_MIN_DELAY), max_delay);
+			}
+			get_interpolated_from_sample_buffer(ch->pitch_buffer, d, hrm->interp, hrm->sinc_table, &ch->allpass_y1, ch->delay_buffer, n_samples);
+			ch->out = ch->delay_buffer;
+		}
+		if (direct) {
+			// the history lacks the latency of the shifter
+			for (uint32_t i=0; i<n_samples; ++i) {
+				d[i] = fminf(fmaxf(d[i] + ch->latency, (float)INTERP_MIN_DELAY), max_delay);
+			}
+			interpolate_sample_buffer(history, block_start, d, hrm->interp, hrm->sinc_table, &ch->direct_y1, ch->direct_buffer, n_samples);
+			direct_out = ch->direct_buffer;
+		}
+	}
+
+	if (!ready) {
+		ch->out = direct_out;
+	} else if (direct) {
+		float* out = ch->delay_buffer;
+		const float* shifted = ch->out;
+		for (uint32_t i=0; i<n_samples; ++i) {
+			out[i] = shifted[i] + (fade->start + fade->step*i) * (direct_out[i] - shifted[i]);
+		}
+		ch->out = out;
+	}
+}
+
+/*
+ * Keeps the pitch buffer of a sleeping voice in step with its input by
+ * silence, so that the voice goes on where it would have been when it
+ * wakes up. The pitch shifters only hold silence by then, they just go on
+ * from there.
+ */
+static void
+sleep_channel(Harmonigilo* hrm, Channel* ch, uint32_t n_samples)
+{
+	if (!ch->shifting) {
+		return;
+	}
+	size_t len = n_samples;
+	if (ch->engine == HRM_ENGINE_VOCODER) {
+		const VocoderAnalysis* va = ch->source->analysis;
+		len = va->n_frames * va->hop;
+	} else if (ch->engine == HRM_ENGINE_DELAYLINE) {
+		// the sweep goes on as well
+		const double phase = ch->shift_phase + n_samples * (1.0 - ch->pitch_scale) / ch->shift_window;
+		ch->shift_phase = phase - floor(phase);
+	}
+	put_silence_to_sample_buffer(ch->pitch_buffer, len);
+	sample_buffer_advance_read_pos(ch->pitch_buffer, n_samples);
+}
 
+/* false if the voice is muted while its shifter catches up */
+static bool
+shift_channel(Harmonigilo* hrm, Channel* ch, uint32_t n_samples)
+{
+	if (ch->prime_left > 0 && !catch_up_channel(hrm, ch, n_samples)) {
+		return !ch->prime_muted;
+	}
+	if (ch->shifting) {
 		pitch_shift(hrm, ch, n_samples);
-//		printf("Delay: %f, %d\n", *ch->delay, ch->delay_samples);
-		get_from_sample_buffer(ch->pitch_buffer, -(ch->delay_samples), ch->delay_buffer, n_samples);
 	}
+	return true;
+}
 
-	float dry_gain = from_dB(*hrm->dry_gain);
-	if ((*hrm->dry_mute>0.5) || (solo && (*hrm->dry_solo<=0.5))) {
-			dry_gain = 0.f;
+static void
+process_channel(Harmonigilo* hrm, Channel* ch, uint32_t n_samples)
+{
+	if (ch->asleep) {
+		// all the history the shifter lacks is silence
+		if (ch->prime_left > 0) {
+			ch->prime_left = 0;
+			ch->pitch_buffer->read_pos = ch->pitch_buffer->write_pos;
+		}
+		sleep_channel(hrm, ch, n_samples);
+		return;
+	}
+	if (!hrm->measuring) {
+		if (shift_channel(hrm, ch, n_samples)) {
+			delay_channel(hrm, ch, n_samples);
+		}
+		return;
+	}
+
+	const uint64_t t0 = dsp_clock_now();
+	const bool audible = shift_channel(hrm, ch, n_samples);
+	const uint64_t t1 = dsp_clock_now();
+	if (audible) {
+		delay_channel(hrm, ch, n_samples);
+	}
+	ch->time_shift += t1 - t0;
+	ch->time_delay += dsp_clock_now() - t1;
+}
+
+/*
+ * Publishes the measured times as averaged percentage of the period. The
+ * stage loads are summed up over the voices, so in parallel mode they can
+ * exceed the load of the whole period.
+ */
+static void
+publish_load(Harmonigilo* hrm, uint64_t t_start, uint32_t n_samples)
+{
+	const uint64_t t_end = dsp_clock_now();
+	const float a = get_load_coeff(hrm, n_samples);
+	const float to_percent = 100.0 * hrm->rate / (1e9 * n_samples);
+
+	uint64_t time_shift = 0;
+	uint64_t time_delay = 0;
+	for (Channel* ch = hrm->channel; ch < hrm->channel+hrm->n_voices; ++ch) {
+		float voice_load = 0.f;
+		if (ch->active) {
+			time_shift += ch->time_shift;
+			time_delay += ch->time_delay;
+			voice_load = (ch->time_shift + ch->time_delay) * to_percent;
+		}
+		ch->avg_load += a * (voice_load - ch->avg_load);
+		*ch->load = ch->avg_load;
+	}
+
+	hrm->avg_dsp += a * ((t_end - t_start) * to_percent - hrm->avg_dsp);
+	hrm->avg_shift += a * (time_shift * to_percent - hrm->avg_shift);
+	hrm->avg_delay += a * (time_delay * to_percent - hrm->avg_delay);
+	hrm->avg_mix += a * (hrm->time_mix * to_percent - hrm->avg_mix);
+
+	*hrm->dsp_load = hrm->avg_dsp;
+	*hrm->load_shift = hrm->avg_shift;
+	*hrm->load_delay = hrm->avg_delay;
+	*hrm->load_mix = hrm->avg_mix;
+}
+
+static void
+clear_load(Harmonigilo* hrm)
+{
+	for (Channel* ch = hrm->channel; ch < hrm->channel+hrm->n_voices; ++ch) {
+		ch->avg_load = 0.f;
+		*ch->load = 0.f;
+	}
+	hrm->avg_dsp = hrm->avg_shift = hrm->avg_delay = hrm->avg_mix = 0.f;
+	*hrm->dsp_load = *hrm->load_shift = *hrm->load_delay = *hrm->load_mix = 0.f;
+}
+
+/* takes the input of the sub-block at offset into the histories of the sources */
+static void
+feed_sources(Harmonigilo* hrm, uint32_t offset, uint32_t n_samples)
+{
+	const float* in_l = hrm->input + offset;
+	hrm->source[HRM_SOURCE_LEFT].data = in_l;
+	if (hrm->stereo) {
+		const float* in_r = hrm->input_r + offset;
+		hrm->source[HRM_SOURCE_RIGHT].data = in_r;
+		for (uint32_t i=0; i<n_samples; ++i) {
+			hrm->mid_input[i] = 0.5f * (in_l[i] + in_r[i]);
+		}
 	}
-	const float dry_pan = *hrm->dry_pan;
+	for (uint32_t s=0; s<hrm->n_sources; ++s) {
+		put_to_sample_buffer(hrm->source[s].history, hrm->source[s].data, n_samples);
+	}
+}
+
+/* the dry signal at the reported latency as it goes out when bypassed,
+ * the read positions of the histories move on like in a processed block */
+static void
+get_bypass_sources(Harmonigilo* hrm, MixBus* bus, uint32_t n_samples)
+{
+	const float g = hrm->stereo ? 1.f : BYPASS_GAIN_MONO;
+	bus->n = 0;
+	const float* left = get_span_from_sample_buffer(hrm->source[HRM_SOURCE_LEFT].history, -(int)hrm->reported_latency, n_samples);
+	mix_bus_add(bus, left, g, hrm->stereo ? 0.f : g, 0.f, 0.f);
+	if (!hrm->stereo) {
+		return;
+	}
+	const float* right = get_span_from_sample_buffer(hrm->source[HRM_SOURCE_RIGHT].history, -(int)hrm->reported_latency, n_samples);
+	mix_bus_add(bus, right, 0.f, 1.f, 0.f, 0.f);
+}
+
+/*
+ * Bypasses the sub-block at offset. Only the histories of the sources are
+ * fed, so that the dry signal keeps its latency and the delay line shifter
+ * has its input right away when the plugin is enabled again. The voices
+ * aren't touched.
+ */
+static void
+bypass_block(Harmonigilo* hrm, uint32_t offset, uint32_t n_samples)
+{
+	feed_sources(hrm, offset, n_samples);
+
+	MixBus bus;
+	get_bypass_sources(hrm, &bus, n_samples);
+	mixdown(&bus, hrm->output_L + offset, hrm->output_R + offset, n_samples);
+
+	*hrm->latency = hrm->reported_latency;
+	hrm->bypassed = true;
+	hrm->fade_primed = true;
+}
+
+/*
+ * Wakes the voices up after a bypass. What the pitch shifters hold is
+ * stale, so they are flushed and primed from the input history, starting
+ * with the next processed block, once it knows the engines and sources.
+ * The shifted voices are muted until then and fade in.
+ */
+static void
+resume_from_bypass(Harmonigilo* hrm)
+{
+	VoiceBank* vb = &hrm->voices;
+	for (Channel* ch = hrm->channel; ch < hrm->channel+hrm->n_voices; ++ch) {
+		reset_channel(hrm, ch);
+		if (ch->shifting) {
+			vb->gain_l.target[ch->voice] = vb->gain_r.target[ch->voice] = 0.f;
+		} else {
+			vb->gain_l.target[ch->voice] = vb->gain_l.current[ch->voice];
+			vb->gain_r.target[ch->voice] = vb->gain_r.current[ch->voice];
+		}
+	}
+	ramp_bank_snap(&vb->gain_l, hrm->n_voices);
+	ramp_bank_snap(&vb->gain_r, hrm->n_voices);
+	for (uint32_t s=0; s<hrm->n_sources; ++s) {
+		hrm->source[s].analysis_active = false;
+	}
+	hrm->bypassed = false;
+	hrm->prime_voices = true;
+}
+
+/* crossfades the processed output of a sub-block with the bypassed signal */
+static void
+fade_bypass(const Ramp* fade, const MixBus* bus, float* out_l, float* out_r, uint32_t n_samples)
+{
 	for (uint32_t i=0; i<n_samples; ++i) {
-		const float in = dry_gain*get_sample_from_sample_buffer(hrm->latency_buffer, -(*hrm->latency));
-		hrm->output_L[i] = in*(1.f-dry_pan);
-		hrm->output_R[i] = in*dry_pan;
+		const float w = fade->start + fade->step*i;
+		float l = 0.f;
+		float r = 0.f;
+		for (uint32_t s=0; s<bus->n; ++s) {
+			const float x = bus->src[s][i];
+			l += bus->gain_l[s] * x;
+			r += bus->gain_r[s] * x;
+		}
+		out_l[i] = w*out_l[i] + (1.f-w)*l;
+		out_r[i] = w*out_r[i] + (1.f-w)*r;
+	}
+}
+
+/*
+ * The silence gate. A voice falls asleep once its source has been quiet
+ * for the hold time and its delay and pitch shifter have played out what
+ * they hold. It wakes up with the first sub-block of its source above the
+ * threshold, which only comes out after the voice's delay and latency, so
+ * nothing of the onset is lost.
+ */
+static void
+update_gate(Harmonigilo* hrm, uint32_t n_samples)
+{
+	if (*hrm->gate_threshold != hrm->seen_threshold) {
+		hrm->seen_threshold = *hrm->gate_threshold;
+		hrm->threshold_lin = from_dB(hrm->seen_threshold);
+	}
+	const bool off = hrm->seen_threshold <= GATE_OFF_DB;
+
+	for (uint32_t s=0; s<hrm->n_sources; ++s) {
+		InputSource* src = &hrm->source[s];
+		float peak = 0.f;
+		if (!off) {
+			for (uint32_t i=0; i<n_samples; ++i) {
+				peak = fmaxf(peak, fabsf(src->data[i]));
+			}
+		}
+		if (off || peak > hrm->threshold_lin) {
+			src->quiet = 0;
+		} else if (src->quiet < UINT32_MAX - n_samples) {
+			src->quiet += n_samples;
+		}
+	}
+}
+
+static void
+process_channel_job(void* arg, uint32_t job)
+{
+	Harmonigilo* hrm = (Harmonigilo*)arg;
+	process_channel(hrm, hrm->jobs[job], hrm->job_samples);
+}
+
+/* processes the sub-block at offset of the host's block, at most block_len long */
+static void
+process_block(Harmonigilo* hrm, uint32_t offset, uint32_t n_samples)
+{
+	const bool measuring = hrm->measuring;
+
+	// the input is read until the mixdown, only then the outputs are
+	// written, so the host may hand in the same buffer for in and out
+	feed_sources(hrm, offset, n_samples);
+	update_gate(hrm, n_samples);
+
+	bool solo = false;
+	if (*hrm->dry_solo > 0.5) {
+		solo = true;
+	}
+
+	// in live mode the engine is the preferred one, the voices may step down
+	PitchEngine engine = HRM_ENGINE_RUBBERBAND;
+	if (*hrm->engine > 1.5) {
+		engine = HRM_ENGINE_VOCODER;
+	} else if (*hrm->engine > 0.5) {
+		engine = HRM_ENGINE_DELAYLINE;
+	}
+	hrm->live_mode = *hrm->live > 0.5;
+	hrm->latency_budget = (uint32_t) rint(fmaxf(*hrm->max_latency, 0.f) * hrm->rate / 1000.0);
+	for (uint32_t s=0; s<hrm->n_sources; ++s) {
+		hrm->source[s].vocoder_used = false;
+		hrm->source[s].vocoder_awake = false;
+	}
+
+	if (*hrm->pan_law != hrm->seen_pan_law || *hrm->width != hrm->seen_width) {
+		hrm->seen_pan_law = *hrm->pan_law;
+		hrm->seen_width = *hrm->width;
+		hrm->law = HRM_PAN_LINEAR;
+		if (*hrm->pan_law > 1.5) {
+			hrm->law = HRM_PAN_COMPROMISE;
+		} else if (*hrm->pan_law > 0.5) {
+			hrm->law = HRM_PAN_CONSTANT_POWER;
+		}
+		hrm->stereo_width = fminf(fmaxf(*hrm->width, 0.f), 1.f);
+		// all the pan gains have to be looked up again
+		for (Channel* ch = hrm->channel; ch < hrm->channel+hrm->n_voices; ++ch) {
+			ch->seen_pan = NAN;
+		}
+		hrm->seen_dry_pan = NAN;
 	}
 
+	update_snapshots(hrm);
 
-	for (Channel* ch = hrm->channel; ch < hrm->channel+CHAN_NUM; ++ch) {
+	const float ramp_coeff = get_ramp_coeff(hrm, n_samples);
+	const uint32_t hold = (uint32_t) (fmaxf(*hrm->gate_hold, 0.f) * hrm->rate / 1000.0);
+	const bool prime = !hrm->ramps_primed;
+	hrm->ramps_primed = true;
+
+	hrm->interp = HRM_INTERP_CUBIC;
+	if (*hrm->interpolation > 1.5) {
+		hrm->interp = HRM_INTERP_SINC;
+	} else if (*hrm->interpolation > 0.5) {
+		hrm->interp = HRM_INTERP_ALLPASS;
+	}
+	// switched off, the depth fades out with the last source
+	float mod_depth = 0.f;
+	if (*hrm->mod_source > 0.5) {
+		hrm->mod = *hrm->mod_source > 1.5 ? HRM_MOD_RANDOM : HRM_MOD_LFO;
+		mod_depth = fminf(fmaxf(*hrm->mod_depth, 0.f), MOD_DEPTH_MAX_MS) * hrm->rate / 1000.0;
+	}
+	hrm->dead_zone_cents = fmaxf(*hrm->dead_zone, 0.f);
+	hrm->mod_inc = fminf(fmaxf(*hrm->mod_rate, 0.f), 5.f) * MOD_TABLE_SIZE / hrm->rate;
+	if (prime) {
+		snap_ramp(&hrm->mod_depth_ramp, mod_depth);
+	} else {
+		ramp_run_linear(&hrm->mod_depth_ramp, mod_depth, DELAY_SLEW, n_samples);
+	}
+	hrm->modulating = hrm->mod_depth_ramp.current > 0.f || ramp_active(&hrm->mod_depth_ramp);
+
+	// faded in unless nothing has gone out yet
+	const float wet = *hrm->enabled > 0 ? 1.f : 0.f;
+	if (!hrm->fade_primed) {
+		snap_ramp(&hrm->bypass_fade, wet);
+		hrm->fade_primed = true;
+	} else {
+		ramp_run_linear(&hrm->bypass_fade, wet, hrm->bypass_step, n_samples);
+	}
+
+	uint32_t n_jobs = 0;
+	for (Channel* ch = hrm->channel; ch < hrm->channel+hrm->n_voices; ++ch) {
 		if (*ch->enabled < 0.5) {
+			if (ch->active) {
+				ch->active = false;
+				hrm->plan_dirty = true;
+			}
 			continue;
 		}
-		const float pan = *ch->pan;
-		float gain = from_dB(*ch->gain);
+		VoiceSetup setup;
+		get_voice_setup(hrm, ch, &setup);
+		if (update_channel(hrm, ch, &setup, engine, ramp_coeff, prime, n_samples)) {
+			hrm->plan_dirty = true;
+		}
+
+		const uint32_t drain = hold + ch->latency + (uint32_t) (fmaxf(hrm->voices.delay[ch->voice], hrm->voices.delay_ramp.current[ch->voice]) + hrm->mod_depth_ramp.current);
+		const bool asleep = ch->source->quiet > drain;
+		ch->asleep = asleep;
+		if (asleep) {
+			++hrm->n_asleep;
+		} else {
+			++hrm->n_awake;
+		}
+
+		if (ch->engine == HRM_ENGINE_VOCODER && ch->shifting) {
+			ch->source->vocoder_used = true;
+			if (!asleep) {
+				ch->source->vocoder_awake = true;
+			}
+		}
+		if (*ch->solo > 0.5) {
+			solo = true;
+		}
+		hrm->jobs[n_jobs++] = ch;
+	}
+
+	if (hrm->plan_dirty) {
+		plan_latency(hrm);
+		hrm->plan_dirty = false;
+	}
+	*hrm->latency = hrm->reported_latency;
+	*hrm->latency_shifter = hrm->shifter_latency;
+	*hrm->latency_hidden = hrm->shifter_latency - hrm->reported_latency;
+
+	// the shifters that have left the dead zone start over and the direct
+	// voice goes on until they are primed, the ones woken up from a bypass
+	// are primed below anyway
+	for (uint32_t j=0; j<n_jobs; ++j) {
+		Channel* ch = hrm->jobs[j];
+		if (!ch->restart) {
+			continue;
+		}
+		ch->restart = false;
+		if (hrm->prime_voices) {
+			continue;
+		}
+		reset_channel(hrm, ch);
+		// the shifted voice starts right at its delay, which has jumped
+		// along with the latency the shifter brings in
+		RampBank* dr = &hrm->voices.delay_ramp;
+		dr->start[ch->voice] = dr->current[ch->voice] = dr->target[ch->voice] = hrm->voices.delay[ch->voice];
+		dr->step[ch->voice] = 0.f;
+		start_priming(hrm, ch, false);
+	}
+
+	if (hrm->prime_voices) {
+		for (uint32_t j=0; j<n_jobs; ++j) {
+			if (hrm->jobs[j]->shifting) {
+				start_priming(hrm, hrm->jobs[j], true);
+			}
+		}
+		hrm->prime_voices = false;
+	}
+
+	// the primed shifters catch up along with the processing, each by
+	// no more than PRIME_BLOCKS sub-blocks, one voice per thread. What a
+	// voice lacks beyond the reach of its delay isn't heard any more.
+	const bool parallel = hrm->workers && *hrm->parallel > 0.5 && n_jobs > 1;
+	uint32_t n_priming = parallel ? hrm->workers->n_threads + 1 : 1;
+	for (uint32_t j=0; j<n_jobs; ++j) {
+		Channel* ch = hrm->jobs[j];
+		ch->prime_chunk = 0;
+		if (ch->prime_left == 0) {
+			continue;
+		}
+		ch->prime_left = MIN(ch->prime_left, get_prime_len(hrm, &hrm->jobs[j], 1));
+		if (n_priming > 0) {
+			ch->prime_chunk = MIN(ch->prime_left, PRIME_BLOCKS*hrm->block_len);
+			--n_priming;
+		}
+	}
+
+	for (uint32_t s=0; s<hrm->n_sources; ++s) {
+		InputSource* src = &hrm->source[s];
+		if (!src->vocoder_used) {
+			src->analysis_active = false;
+			continue;
+		}
+		if (!src->analysis_active) {
+			reset_vocoder_analysis(src->analysis);
+			src->analysis_active = true;
+		}
+		// the one analysis all voices of the source resynthesize from,
+		// the sleeping ones only need to know how many frames are done
+		if (src->vocoder_awake) {
+			vocoder_analyse(src->analysis, src->data, n_samples);
+		} else {
+			vocoder_skip(src->analysis, n_samples);
+		}
+	}
+
+	// the delays of the voices that aren't processed stand still
+	VoiceBank* vb = &hrm->voices;
+	ramp_bank_hold(&vb->delay_ramp, hrm->n_voices);
+	for (uint32_t j=0; j<n_jobs; ++j) {
+		const uint32_t v = hrm->jobs[j]->voice;
+		vb->delay_ramp.target[v] = vb->delay[v];
+	}
+	if (prime) {
+		ramp_bank_snap(&vb->delay_ramp, hrm->n_voices);
+	} else {
+		ramp_bank_run_linear(&vb->delay_ramp, DELAY_SLEW, hrm->n_voices, n_samples);
+	}
+
+	if (parallel) {
+		hrm->job_samples = n_samples;
+		worker_pool_run(hrm->workers, process_channel_job, hrm, n_jobs);
+	} else {
+		for (uint32_t j=0; j<n_jobs; ++j) {
+			process_channel(hrm, hrm->jobs[j], n_samples);
+		}
+	}
+
+	const uint64_t t_mix = measuring ? dsp_clock_now() : 0;
+
+	if (*hrm->dry_gain != hrm->seen_dry_gain) {
+		hrm->seen_dry_gain = *hrm->dry_gain;
+		hrm->dry_gain_lin = from_dB(hrm->seen_dry_gain);
+		++hrm->reconfiguration_count;
+	}
+	if (*hrm->dry_pan != hrm->seen_dry_pan) {
+		hrm->seen_dry_pan = *hrm->dry_pan;
+		pan_gains(hrm->pan_table, hrm->law, hrm->seen_dry_pan, &hrm->dry_pan_l, &hrm->dry_pan_r);
+		++hrm->reconfiguration_count;
+	}
+
+	float dry_gain = hrm->dry_gain_lin;
+	if ((*hrm->dry_mute>0.5) || (solo && (*hrm->dry_solo<=0.5))) {
+			dry_gain = 0.f;
+	}
+
+	if (prime) {
+		snap_ramp(&hrm->dry_gain_l, dry_gain*hrm->dry_pan_l);
+		snap_ramp(&hrm->dry_gain_r, dry_gain*hrm->dry_pan_r);
+	} else {
+		ramp_run(&hrm->dry_gain_l, dry_gain*hrm->dry_pan_l, ramp_coeff, n_samples);
+		ramp_run(&hrm->dry_gain_r, dry_gain*hrm->dry_pan_r, ramp_coeff, n_samples);
+	}
+
+	// dry signal and voices are mixed right out of their ring buffers, the
+	// bypassed signal is the same dry signal with other gains
+	MixBus bypass;
+	get_bypass_sources(hrm, &bypass, n_samples);
+
+	MixBus bus;
+	bus.n = 0;
+	if (hrm->stereo) {
+		// the dry pan is a balance, left stays left and right right
+		mix_bus_add(&bus, bypass.src[0], hrm->dry_gain_l.start, 0.f, hrm->dry_gain_l.step, 0.f);
+		mix_bus_add(&bus, bypass.src[1], 0.f, hrm->dry_gain_r.start, 0.f, hrm->dry_gain_r.step);
+	} else {
+		mix_bus_add(&bus, bypass.src[0], hrm->dry_gain_l.start, hrm->dry_gain_r.start, hrm->dry_gain_l.step, hrm->dry_gain_r.step);
+	}
+
+	// the gains of the voices that aren't processed stand still
+	ramp_bank_hold(&vb->gain_l, hrm->n_voices);
+	ramp_bank_hold(&vb->gain_r, hrm->n_voices);
+	for (uint32_t j=0; j<n_jobs; ++j) {
+		const Channel* ch = hrm->jobs[j];
+		const uint32_t v = ch->voice;
+		float gain = vb->gain[v];
 		if ((*ch->mute>0.5) || (solo && (*ch->solo<=0.5))) {
 			gain = 0.f;
 		}
-		for (uint32_t i=0; i<n_samples; ++i) {
-			const float p = gain*ch->delay_buffer[i];
-			hrm->output_L[i] += p*(1.f-pan);
-			hrm->output_R[i] += p*pan;
+		if (ch->prime_muted && (ch->prime_left > 0 || ch->shift_wait > 0)) {
+			gain = 0.f;
+		}
+		vb->gain_l.target[v] = gain*vb->pan_l[v];
+		vb->gain_r.target[v] = gain*vb->pan_r[v];
+	}
+	if (prime) {
+		ramp_bank_snap(&vb->gain_l, hrm->n_voices);
+		ramp_bank_snap(&vb->gain_r, hrm->n_voices);
+	} else {
+		ramp_bank_run(&vb->gain_l, ramp_coeff, hrm->n_voices, n_samples);
+		ramp_bank_run(&vb->gain_r, ramp_coeff, hrm->n_voices, n_samples);
+	}
+
+	for (uint32_t j=0; j<n_jobs; ++j) {
+		const Channel* ch = hrm->jobs[j];
+		const uint32_t v = ch->voice;
+		if (ch->asleep) {
+			continue;
 		}
+		if (vb->gain_l.start[v] == 0.f && vb->gain_r.start[v] == 0.f
+		    && !ramp_bank_active(&vb->gain_l, v) && !ramp_bank_active(&vb->gain_r, v)) {
+			continue;
+		}
+		mix_bus_add(&bus, ch->out, vb->gain_l.start[v], vb->gain_r.start[v], vb->gain_l.step[v], vb->gain_r.step[v]);
+	}
+
+	mixdown(&bus, hrm->output_L + offset, hrm->output_R + offset, n_samples);
+
+	if (hrm->bypass_fade.start < 1.f || ramp_active(&hrm->bypass_fade)) {
+		fade_bypass(&hrm->bypass_fade, &bypass, hrm->output_L + offset, hrm->output_R + offset, n_samples);
+	}
+
+	if (measuring) {
+		hrm->time_mix += dsp_clock_now() - t_mix;
+	}
+}
+
+static void
+run(LV2_Handle instance, uint32_t n_samples)
+{
+	Harmonigilo* hrm = (Harmonigilo*)instance;
+
+	// the clock is only read if the load is asked for
+	const bool measuring = *hrm->measure_load > 0.5;
+	if (measuring != hrm->measuring) {
+		hrm->measuring = measuring;
+		if (!measuring) {
+			clear_load(hrm);
+		}
+	}
+	const uint64_t t_start = measuring ? dsp_clock_now() : 0;
+
+	if (measuring) {
+		for (Channel* ch = hrm->channel; ch < hrm->channel+hrm->n_voices; ++ch) {
+			ch->time_shift = ch->time_delay = 0;
+		}
+		hrm->time_mix = 0;
+	}
+
+	// once faded out the voices sleep until the plugin is enabled again
+	const bool enabled = *hrm->enabled > 0;
+	hrm->n_awake = hrm->n_asleep = 0;
+	for (uint32_t offset=0; offset<n_samples; offset+=hrm->block_len) {
+		const uint32_t n = MIN(hrm->block_len, n_samples-offset);
+		if (!enabled && hrm->bypass_fade.current == 0.f) {
+			bypass_block(hrm, offset, n);
+			continue;
+		}
+		if (hrm->bypassed) {
+			resume_from_bypass(hrm);
+		}
+		process_block(hrm, offset, n);
+	}
+
+	*hrm->reconfigurations = hrm->reconfiguration_count;
+
+	// a period counts as slept if none of the enabled voices was processed
+	if (hrm->n_awake + hrm->n_asleep > 0) {
+		++hrm->n_periods;
+		if (hrm->n_awake == 0) {
+			++hrm->n_periods_slept;
+		}
+	}
+	*hrm->slept = hrm->n_periods ? 100.f * hrm->n_periods_slept / hrm->n_periods : 0.f;
+
+	if (measuring) {
+		publish_load(hrm, t_start, n_samples);
 	}
 }
 
@@ -455,40 +2356,111 @@ static void
 cleanup(LV2_Handle instance)
 {
 	Harmonigilo* hrm = (Harmonigilo*)instance;
-	for (int i=0; i<CHAN_NUM; ++i) {
-		rubberband_delete(hrm->channel[i].pitcher);
-		delete_sample_buffer(hrm->channel[i].pitch_buffer);
-		free (hrm->channel[i].delay_buffer);
+	for (uint32_t i=0; i<hrm->n_voices; ++i) {
+		if (hrm->channel[i].pitcher) {
+			rubberband_delete(hrm->channel[i].pitcher);
+		}
+	}
+	arena_release(&hrm->arena);
+	release_vocoder_plan(hrm->shared, hrm->vocoder_plan);
+	release_shared_engine(hrm->shared);
+	cache_aligned_free(hrm);
+}
+
+/* the snapshots as one blob, as run() has published them last */
+static LV2_State_Status
+save(LV2_Handle instance,
+     LV2_State_Store_Function store,
+     LV2_State_Handle handle,
+     uint32_t flags,
+     const LV2_Feature* const* features)
+{
+	Harmonigilo* hrm = (Harmonigilo*)instance;
+	if (!hrm->map) {
+		return LV2_STATE_ERR_NO_FEATURE;
+	}
+
+	SnapshotState st;
+	uint32_t seen = 1; // odd, so any finished write is new
+	while (!snapshot_exchange_read(&hrm->saved, &st, &seen)) {
+		sched_yield();
+	}
+	st.version = SNAPSHOT_STATE_VERSION;
+	st.n_voices = hrm->n_voices;
+
+	return store(handle, hrm->urid_snapshots, &st, sizeof(SnapshotState),
+		     hrm->urid_chunk, LV2_STATE_IS_POD);
+}
+
+/* hands the snapshots over to run(), which takes them with its next period */
+static LV2_State_Status
+restore(LV2_Handle instance,
+	LV2_State_Retrieve_Function retrieve,
+	LV2_State_Handle handle,
+	uint32_t flags,
+	const LV2_Feature* const* features)
+{
+	Harmonigilo* hrm = (Harmonigilo*)instance;
+	if (!hrm->map) {
+		return LV2_STATE_ERR_NO_FEATURE;
+	}
+
+	size_t size;
+	uint32_t type;
+	uint32_t value_flags;
+	const SnapshotState* st = (const SnapshotState*)
+		retrieve(handle, hrm->urid_snapshots, &size, &type, &value_flags);
+	if (!st) {
+		return LV2_STATE_ERR_NO_PROPERTY;
+	}
+	if (type != hrm->urid_chunk || size != sizeof(SnapshotState)
+	    || st->version != SNAPSHOT_STATE_VERSION || st->n_voices != hrm->n_voices) {
+		return LV2_STATE_ERR_BAD_TYPE;
 	}
-	free (hrm->copied_input);
-	free (hrm->retrieve_buffer);
-	delete_sample_buffer(hrm->latency_buffer);
-	free(instance);
+
+	snapshot_exchange_write(&hrm->restored, st);
+	return LV2_STATE_SUCCESS;
 }
 
 static const void*
 extension_data(const char* uri)
 {
+	static const LV2_State_Interface state = { save, restore };
+	if (!strcmp(uri, LV2_STATE__interface)) {
+		return &state;
+	}
 	return NULL;
 }
 
-static const LV2_Descriptor descriptor = {
-	HRM_URI "lv2",
-	instantiate,
-	connect_port,
-	activate,
-	run,
-	deactivate,
-	cleanup,
-	extension_data
+#define HRM_DESCRIPTOR(URI_SUFFIX) {		\
+	HRM_URI "lv2" URI_SUFFIX,		\
+	instantiate,				\
+	connect_port,				\
+	activate,				\
+	run,					\
+	deactivate,				\
+	cleanup,				\
+	extension_data				\
+}
+
+// in the order of hrm_variants[], then the stereo input and the long delay variant
+static const LV2_Descriptor descriptors[] = {
+	HRM_DESCRIPTOR(""),
+	HRM_DESCRIPTOR("_2"),
+	HRM_DESCRIPTOR("_4"),
+	HRM_DESCRIPTOR("_8"),
+	HRM_DESCRIPTOR("_12"),
+	HRM_DESCRIPTOR("_16"),
+	HRM_DESCRIPTOR(HRM_STEREO_SUFFIX),
+	HRM_DESCRIPTOR(HRM_LONG_SUFFIX)
 };
 
 LV2_SYMBOL_EXPORT
 const LV2_Descriptor*
 lv2_descriptor(uint32_t index)
 {
-	switch (index) {
-	case 0:  return &descriptor;
-	default: return NULL;
+	if (index >= sizeof(descriptors)/sizeof(descriptors[0])) {
+		return NULL;
 	}
+	return &descriptors[index];
 }
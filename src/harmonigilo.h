@@ -18,11 +18,27 @@
 #ifndef HRM_H
 #define HRM_H
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 #define HRM_URI "http://johannes-mueller.org/oss/lv2/harmonigilo#"
 
-#define CHAN_NUM 6
+// the plugin comes in variants of 2 up to MAX_CHAN_NUM voices
+#define MAX_CHAN_NUM 16
+#define DEFAULT_CHAN_NUM 6
+
+// the longest voice delays in ms, of the long delay variant and of the others
+#define HRM_MAX_DELAY_MS 50.0
+#define HRM_LONG_MAX_DELAY_MS 4000.0
+
+// the DSP data is aligned to cache lines
+#define CACHE_LINE 64
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE)))
 
-#define MAXDELAY 1000.0
+// ports of voice n are at HRM_VOICE_PORTS*n + VoicePortIndex
+#define HRM_VOICE_PORTS 7
 
 typedef enum {
 	HRM_ENABLED_0 = 0,
@@ -31,19 +47,176 @@ typedef enum {
 	HRM_PAN_0 = 3,
 	HRM_GAIN_0 = 4,
 	HRM_MUTE_0 = 5,
-	HRM_SOLO_0 = 6,
-
-	HRM_DRY_PAN = 42,
-	HRM_DRY_GAIN = 43,
-	HRM_DRY_MUTE = 44,
-	HRM_DRY_SOLO = 45,
-
-	HRM_LATENCY = 46,
-	HRM_ENABLED = 47,
-	HRM_INPUT = 48,
-	HRM_OUTPUT_L = 49,
-	HRM_OUTPUT_R = 50
+	HRM_SOLO_0 = 6
+} VoicePortIndex;
+
+/* The global ports follow the ports of the voices, so these are relative
+ * to HRM_VOICE_PORTS*n_voices, see hrm_port(). The last block has one
+ * port per voice. lv2ttl/genttl.sh reads HRM_VOICE_LOAD_0 from here. */
+typedef enum {
+	HRM_DRY_PAN = 0,
+	HRM_DRY_GAIN = 1,
+	HRM_DRY_MUTE = 2,
+	HRM_DRY_SOLO = 3,
+
+	HRM_LATENCY = 4,
+	HRM_ENABLED = 5,
+	HRM_INPUT = 6,
+	HRM_OUTPUT_L = 7,
+	HRM_OUTPUT_R = 8,
+
+	HRM_PARALLEL = 9,
+	HRM_ENGINE = 10,
+	HRM_RECONFIGURATIONS = 11,
+
+	HRM_MEASURE_LOAD = 12,
+	HRM_DSP_LOAD = 13,
+	HRM_LOAD_SHIFT = 14,
+	HRM_LOAD_DELAY = 15,
+	HRM_LOAD_MIX = 16,
+	HRM_LATENCY_SHIFTER = 17,
+	HRM_LATENCY_HIDDEN = 18,
+
+	HRM_PAN_LAW = 19,
+	HRM_WIDTH = 20,
+
+	HRM_MORPH_ENABLE = 21,
+	HRM_MORPH = 22,
+	HRM_STORE_A = 23,
+	HRM_STORE_B = 24,
+
+	HRM_GATE_THRESHOLD = 25,
+	HRM_GATE_HOLD = 26,
+	HRM_SLEPT = 27,
+
+	HRM_LIVE = 28,
+	HRM_MAX_LATENCY = 29,
+
+	HRM_INTERPOLATION = 30,
+	HRM_MOD_SOURCE = 31,
+	HRM_MOD_RATE = 32,
+	HRM_MOD_DEPTH = 33,
+
+	HRM_DEAD_ZONE = 34,
+
+	HRM_VOICE_LOAD_0 = 35
 } PortIndex;
 
+static inline uint32_t
+hrm_port(uint32_t n_voices, PortIndex port)
+{
+	return HRM_VOICE_PORTS*n_voices + port;
+}
+
+static inline uint32_t
+hrm_n_ports(uint32_t n_voices)
+{
+	return hrm_port(n_voices, HRM_VOICE_LOAD_0) + n_voices;
+}
+
+/* The stereo input variant has the right input and the source of each
+ * voice after the ports all variants have. HRM_INPUT is the left input. */
+static inline uint32_t
+hrm_input_r_port(uint32_t n_voices)
+{
+	return hrm_n_ports(n_voices);
+}
+
+static inline uint32_t
+hrm_source_port(uint32_t n_voices, uint32_t voice)
+{
+	return hrm_n_ports(n_voices) + 1 + voice;
+}
+
+static inline uint32_t
+hrm_n_ports_stereo(uint32_t n_voices)
+{
+	return hrm_n_ports(n_voices) + 1 + n_voices;
+}
+
+/* The voice counts of the variants. The default one keeps the plugin URI
+ * of the time before the variants, the others get _<n_voices> appended. */
+static const uint32_t hrm_variants[] = { DEFAULT_CHAN_NUM, 2, 4, 8, 12, 16 };
+#define HRM_N_VARIANTS (sizeof(hrm_variants)/sizeof(hrm_variants[0]))
+
+// the stereo input and the long delay variant have the default number of voices
+#define HRM_STEREO_SUFFIX "_stereo"
+#define HRM_LONG_SUFFIX "_long"
+
+/* the number of voices of the variant with the given plugin URI */
+static inline uint32_t
+hrm_variant_voices(const char* uri)
+{
+	const char* base = HRM_URI "lv2";
+	const size_t len = strlen(base);
+	if (strncmp(uri, base, len) != 0 || uri[len] != '_') {
+		return DEFAULT_CHAN_NUM;
+	}
+	const uint32_t n_voices = (uint32_t) atoi(uri+len+1);
+	for (uint32_t v=0; v<HRM_N_VARIANTS; ++v) {
+		if (hrm_variants[v] == n_voices) {
+			return n_voices;
+		}
+	}
+	return DEFAULT_CHAN_NUM;
+}
+
+static inline bool
+hrm_variant_stereo(const char* uri)
+{
+	const char* base = HRM_URI "lv2" HRM_STEREO_SUFFIX;
+	return strncmp(uri, base, strlen(base)) == 0;
+}
+
+static inline bool
+hrm_variant_long(const char* uri)
+{
+	const char* base = HRM_URI "lv2" HRM_LONG_SUFFIX;
+	return strncmp(uri, base, strlen(base)) == 0;
+}
+
+/* the maximum of the delay controls in ms, the delay memory is sized by it */
+static inline double
+hrm_variant_max_delay(const char* uri)
+{
+	return hrm_variant_long(uri) ? HRM_LONG_MAX_DELAY_MS : HRM_MAX_DELAY_MS;
+}
+
+typedef enum {
+	HRM_ENGINE_RUBBERBAND = 0,
+	HRM_ENGINE_DELAYLINE = 1,
+	HRM_ENGINE_VOCODER = 2
+} PitchEngine;
+
+typedef enum {
+	HRM_PAN_LINEAR = 0,
+	HRM_PAN_CONSTANT_POWER = 1,
+	HRM_PAN_COMPROMISE = 2,
+	HRM_N_PAN_LAWS
+} PanLaw;
+
+/* what a voice takes as input, the mono variants only have the left one */
+typedef enum {
+	HRM_SOURCE_LEFT = 0,
+	HRM_SOURCE_RIGHT = 1,
+	HRM_SOURCE_MID = 2,
+	HRM_N_SOURCES
+} VoiceSource;
+
+/* how the voice delays are read between the samples */
+typedef enum {
+	HRM_INTERP_CUBIC = 0,
+	HRM_INTERP_ALLPASS = 1,
+	HRM_INTERP_SINC = 2
+} DelayInterpolation;
+
+/* what moves the voice delays */
+typedef enum {
+	HRM_MOD_OFF = 0,
+	HRM_MOD_LFO = 1,
+	HRM_MOD_RANDOM = 2,
+	HRM_N_MOD_SOURCES
+} ModSource;
+
 
 #endif // HRM_H
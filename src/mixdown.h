@@ -0,0 +1,178 @@
+/*
+    Copyright (C) 2016 Johannes Mueller <github@johannes-mueller.org>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    version 2 as published by the Free Software Foundation;
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Mixes any number of mono sources with a left and a right gain each into
+ * a stereo output in one pass. The output is written, not accumulated, so
+ * it is touched only once per sample.
+ *
+ * The gains may ramp linearly, by step_l and step_r per sample. If none of
+ * them does, the cheaper constant gain loop is taken.
+ *
+ * The sources are a bus of arrays, the gains of all sources lie side by
+ * side in aligned memory. The loops run over the samples in SIMD vectors
+ * and over the sources inside, so each output vector is stored once and
+ * the sources are read straight from where they are.
+ */
+
+#ifndef HRM_MIXDOWN_H
+#define HRM_MIXDOWN_H
+
+#include <math.h>
+#include <stdint.h>
+
+#include "harmonigilo.h"
+
+#ifdef __AVX__
+#include <immintrin.h>
+#elif defined __SSE__
+#include <xmmintrin.h>
+#endif
+
+// the voices and the dry signal, which is left and right in the stereo variant
+#define MAX_MIX_SOURCES (MAX_CHAN_NUM+2)
+
+typedef struct {
+	float gain_l[MAX_MIX_SOURCES] CACHE_ALIGNED;
+	float gain_r[MAX_MIX_SOURCES] CACHE_ALIGNED;
+	float step_l[MAX_MIX_SOURCES] CACHE_ALIGNED;
+	float step_r[MAX_MIX_SOURCES] CACHE_ALIGNED;
+	const float* src[MAX_MIX_SOURCES];
+	uint32_t n;
+} MixBus;
+
+static inline void
+mix_bus_add(MixBus* bus, const float* src, float gain_l, float gain_r, float step_l, float step_r)
+{
+	const uint32_t s = bus->n++;
+	bus->src[s] = src;
+	bus->gain_l[s] = gain_l;
+	bus->gain_r[s] = gain_r;
+	bus->step_l[s] = step_l;
+	bus->step_r[s] = step_r;
+}
+
+static inline bool
+mix_bus_ramped(const MixBus* bus)
+{
+	float steps = 0.f;
+	for (uint32_t s=0; s<bus->n; ++s) {
+		steps += fabsf(bus->step_l[s]) + fabsf(bus->step_r[s]);
+	}
+	return steps != 0.f;
+}
+
+static void
+mixdown_scalar(const MixBus* bus, float* out_l, float* out_r, uint32_t from, uint32_t to)
+{
+	for (uint32_t i=from; i<to; ++i) {
+		float l = 0.f;
+		float r = 0.f;
+		for (uint32_t s=0; s<bus->n; ++s) {
+			const float x = bus->src[s][i];
+			l += (bus->gain_l[s] + bus->step_l[s]*i) * x;
+			r += (bus->gain_r[s] + bus->step_r[s]*i) * x;
+		}
+		out_l[i] = l;
+		out_r[i] = r;
+	}
+}
+
+static void
+mixdown_ramped(const MixBus* bus, float* out_l, float* out_r, uint32_t n_samples)
+{
+	uint32_t i = 0;
+
+#ifdef __AVX__
+	const __m256 idx = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+	for (; i+8 <= n_samples; i+=8) {
+		__m256 l = _mm256_setzero_ps();
+		__m256 r = _mm256_setzero_ps();
+		for (uint32_t s=0; s<bus->n; ++s) {
+			const __m256 x = _mm256_loadu_ps(bus->src[s] + i);
+			const __m256 sl = _mm256_set1_ps(bus->step_l[s]);
+			const __m256 sr = _mm256_set1_ps(bus->step_r[s]);
+			const __m256 gl = _mm256_add_ps(_mm256_set1_ps(bus->gain_l[s] + bus->step_l[s]*i), _mm256_mul_ps(sl, idx));
+			const __m256 gr = _mm256_add_ps(_mm256_set1_ps(bus->gain_r[s] + bus->step_r[s]*i), _mm256_mul_ps(sr, idx));
+			l = _mm256_add_ps(l, _mm256_mul_ps(x, gl));
+			r = _mm256_add_ps(r, _mm256_mul_ps(x, gr));
+		}
+		_mm256_storeu_ps(out_l + i, l);
+		_mm256_storeu_ps(out_r + i, r);
+	}
+#elif defined __SSE__
+	const __m128 idx = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+	for (; i+4 <= n_samples; i+=4) {
+		__m128 l = _mm_setzero_ps();
+		__m128 r = _mm_setzero_ps();
+		for (uint32_t s=0; s<bus->n; ++s) {
+			const __m128 x = _mm_loadu_ps(bus->src[s] + i);
+			const __m128 sl = _mm_set1_ps(bus->step_l[s]);
+			const __m128 sr = _mm_set1_ps(bus->step_r[s]);
+			const __m128 gl = _mm_add_ps(_mm_set1_ps(bus->gain_l[s] + bus->step_l[s]*i), _mm_mul_ps(sl, idx));
+			const __m128 gr = _mm_add_ps(_mm_set1_ps(bus->gain_r[s] + bus->step_r[s]*i), _mm_mul_ps(sr, idx));
+			l = _mm_add_ps(l, _mm_mul_ps(x, gl));
+			r = _mm_add_ps(r, _mm_mul_ps(x, gr));
+		}
+		_mm_storeu_ps(out_l + i, l);
+		_mm_storeu_ps(out_r + i, r);
+	}
+#endif
+
+	mixdown_scalar(bus, out_l, out_r, i, n_samples);
+}
+
+static void
+mixdown(const MixBus* bus, float* out_l, float* out_r, uint32_t n_samples)
+{
+	if (mix_bus_ramped(bus)) {
+		mixdown_ramped(bus, out_l, out_r, n_samples);
+		return;
+	}
+
+	uint32_t i = 0;
+
+#ifdef __AVX__
+	for (; i+8 <= n_samples; i+=8) {
+		__m256 l = _mm256_setzero_ps();
+		__m256 r = _mm256_setzero_ps();
+		for (uint32_t s=0; s<bus->n; ++s) {
+			const __m256 x = _mm256_loadu_ps(bus->src[s] + i);
+			l = _mm256_add_ps(l, _mm256_mul_ps(x, _mm256_set1_ps(bus->gain_l[s])));
+			r = _mm256_add_ps(r, _mm256_mul_ps(x, _mm256_set1_ps(bus->gain_r[s])));
+		}
+		_mm256_storeu_ps(out_l + i, l);
+		_mm256_storeu_ps(out_r + i, r);
+	}
+#elif defined __SSE__
+	for (; i+4 <= n_samples; i+=4) {
+		__m128 l = _mm_setzero_ps();
+		__m128 r = _mm_setzero_ps();
+		for (uint32_t s=0; s<bus->n; ++s) {
+			const __m128 x = _mm_loadu_ps(bus->src[s] + i);
+			l = _mm_add_ps(l, _mm_mul_ps(x, _mm_set1_ps(bus->gain_l[s])));
+			r = _mm_add_ps(r, _mm_mul_ps(x, _mm_set1_ps(bus->gain_r[s])));
+		}
+		_mm_storeu_ps(out_l + i, l);
+		_mm_storeu_ps(out_r + i, r);
+	}
+#endif
+
+	mixdown_scalar(bus, out_l, out_r, i, n_samples);
+}
+
+#endif // HRM_MIXDOWN_H
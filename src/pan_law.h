@@ -0,0 +1,82 @@
+/*
+    Copyright (C) 2016 Johannes Mueller <github@johannes-mueller.org>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    version 2 as published by the Free Software Foundation;
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Pan laws as lookup tables. A table holds the gain of one side over its
+ * share of the signal from 0 to 1, the other side reads it mirrored. The
+ * gains are only looked up when a pan changes, the mix itself just
+ * multiplies by them.
+ *
+ *   linear            x                    centre -6 dB
+ *   constant power    sin(x*pi/2)          centre -3 dB
+ *   compromise        sqrt(x*sin(x*pi/2))  centre -4.5 dB
+ */
+
+#ifndef HRM_PAN_LAW_H
+#define HRM_PAN_LAW_H
+
+#include <math.h>
+#include <stdint.h>
+
+#include "harmonigilo.h"
+
+#define PAN_TABLE_SIZE 256
+
+typedef struct {
+	float gain[HRM_N_PAN_LAWS][PAN_TABLE_SIZE+1];
+} PanTable;
+
+static void
+init_pan_table(PanTable* pt)
+{
+	for (uint32_t i=0; i<=PAN_TABLE_SIZE; ++i) {
+		const double x = (double)i / PAN_TABLE_SIZE;
+		const double cp = sin(x * 3.14159265358979323846 / 2.0);
+		pt->gain[HRM_PAN_LINEAR][i] = (float)x;
+		pt->gain[HRM_PAN_CONSTANT_POWER][i] = (float)cp;
+		pt->gain[HRM_PAN_COMPROMISE][i] = (float)sqrt(x * cp);
+	}
+	// sin() doesn't quite reach 1 at pi/2
+	pt->gain[HRM_PAN_CONSTANT_POWER][PAN_TABLE_SIZE] = 1.f;
+	pt->gain[HRM_PAN_COMPROMISE][PAN_TABLE_SIZE] = 1.f;
+}
+
+/* the gain of the side that gets share x (0..1) of the signal */
+static inline float
+pan_table_gain(const PanTable* pt, PanLaw law, float x)
+{
+	const float* g = pt->gain[law];
+	if (x <= 0.f) {
+		return g[0];
+	}
+	if (x >= 1.f) {
+		return g[PAN_TABLE_SIZE];
+	}
+	const float pos = x * PAN_TABLE_SIZE;
+	const uint32_t i = (uint32_t)pos;
+	return g[i] + (pos - i) * (g[i+1] - g[i]);
+}
+
+/* left and right gain of pan (0 left, 1 right) */
+static inline void
+pan_gains(const PanTable* pt, PanLaw law, float pan, float* gain_l, float* gain_r)
+{
+	*gain_l = pan_table_gain(pt, law, 1.f - pan);
+	*gain_r = pan_table_gain(pt, law, pan);
+}
+
+#endif // HRM_PAN_LAW_H
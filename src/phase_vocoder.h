@@ -0,0 +1,355 @@
+/*
+    Copyright (C) 2016 Johannes Mueller <github@johannes-mueller.org>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    version 2 as published by the Free Software Foundation;
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Phase vocoder pitch shifter split into an analysis stage and a
+ * synthesis stage.
+ *
+ * All voices shift the same input signal, so the STFT analysis runs only
+ * once per block. It collects the magnitude and the true frequency of each
+ * bin for every frame that has been completed during the block. Every
+ * voice then resynthesizes these frames with its own pitch scale.
+ *
+ * The window and the FFT plans only depend on the frame size, so they are
+ * made once in a VocoderPlan that any number of analyses and voices of
+ * that size may share, also across threads. The plans are executed on
+ * the buffers of the analyses and voices, which are all cache line
+ * aligned like the ones they are planned with.
+ */
+
+#ifndef HRM_PHASE_VOCODER_H
+#define HRM_PHASE_VOCODER_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fftw3.h>
+
+#include "arena.h"
+
+#define VOCODER_OVERSAMPLING 4
+#define VOCODER_PI 3.14159265358979323846
+
+typedef struct {
+	uint32_t size;
+	double* window;
+	fftw_plan forward;
+	fftw_plan backward;
+} VocoderPlan;
+
+typedef struct {
+	uint32_t size;
+	uint32_t hop;
+	uint32_t n_bins;
+
+	const double* window;
+	fftw_plan forward;
+	fftw_plan backward;
+
+	float* in_fifo;
+	uint32_t fill;
+
+	double* frame;
+	fftw_complex* spectrum;
+	double* last_phase;
+
+	uint32_t max_frames;
+	uint32_t n_frames;
+	float* magnitude;
+	float* frequency;
+} VocoderAnalysis;
+
+typedef struct {
+	double* sum_phase;
+	float* syn_magnitude;
+	float* syn_frequency;
+
+	fftw_complex* spectrum;
+	double* frame;
+
+	// the first hop of out_accum is handed out and only dropped with the
+	// next frame, so it doesn't need to be copied
+	float* out_accum;
+	bool hop_pending;
+} VocoderVoice;
+
+static uint32_t
+vocoder_frame_size(double rate)
+{
+	// next power of two of 20ms
+	const uint32_t min_size = (uint32_t) rint(rate * 0.02);
+	uint32_t size = 256;
+	while (size < min_size) {
+		size <<= 1;
+	}
+	return size;
+}
+
+/* Makes the window and the FFT plans for frames of size samples. FFTW's
+ * planner isn't thread safe, so the caller has to make sure that no other
+ * thread plans at the same time. */
+static bool
+init_vocoder_plan(VocoderPlan* vp, uint32_t size)
+{
+	const uint32_t n_bins = size/2 + 1;
+	double* frame = (double*)cache_aligned_alloc(size*sizeof(double));
+	fftw_complex* spectrum = (fftw_complex*)cache_aligned_alloc(n_bins*sizeof(fftw_complex));
+
+	memset(vp, 0, sizeof(VocoderPlan));
+	vp->window = (double*)malloc(size*sizeof(double));
+	if (frame && spectrum && vp->window) {
+		vp->size = size;
+		for (uint32_t i=0; i<size; ++i) {
+			vp->window[i] = 0.5 - 0.5*cos(2.0*VOCODER_PI*i/size);
+		}
+		vp->forward = fftw_plan_dft_r2c_1d(size, frame, spectrum, FFTW_ESTIMATE);
+		vp->backward = fftw_plan_dft_c2r_1d(size, spectrum, frame, FFTW_ESTIMATE);
+	}
+	cache_aligned_free(frame);
+	cache_aligned_free(spectrum);
+	return vp->forward && vp->backward;
+}
+
+/* the same as for init_vocoder_plan() goes for the planner */
+static void
+destroy_vocoder_plan(VocoderPlan* vp)
+{
+	if (vp->forward) {
+		fftw_destroy_plan(vp->forward);
+	}
+	if (vp->backward) {
+		fftw_destroy_plan(vp->backward);
+	}
+	free(vp->window);
+	memset(vp, 0, sizeof(VocoderPlan));
+}
+
+/* the output lags behind the input by this many samples */
+static uint32_t
+vocoder_latency(const VocoderAnalysis* va)
+{
+	return va->size;
+}
+
+static void
+reset_vocoder_analysis(VocoderAnalysis* va)
+{
+	memset(va->in_fifo, 0, va->size*sizeof(float));
+	memset(va->last_phase, 0, va->n_bins*sizeof(double));
+	va->fill = va->size - va->hop;
+	va->n_frames = 0;
+}
+
+/*
+ * The analysis and its buffers are carved from the arena, it works with
+ * the window and the FFT plans of vp, which has to outlive it. max_block
+ * is the largest number of samples passed to vocoder_analyse().
+ */
+static VocoderAnalysis*
+new_vocoder_analysis(Arena* arena, const VocoderPlan* vp, uint32_t max_block)
+{
+	const uint32_t size = vp->size;
+	const uint32_t hop = size / VOCODER_OVERSAMPLING;
+	const uint32_t n_bins = size/2 + 1;
+	const uint32_t max_frames = max_block / hop + 1;
+
+	VocoderAnalysis* va = (VocoderAnalysis*)arena_alloc(arena, sizeof(VocoderAnalysis));
+	double* frame = (double*)arena_alloc(arena, size*sizeof(double));
+	fftw_complex* spectrum = (fftw_complex*)arena_alloc(arena, n_bins*sizeof(fftw_complex));
+	float* in_fifo = (float*)arena_alloc(arena, size*sizeof(float));
+	double* last_phase = (double*)arena_alloc(arena, n_bins*sizeof(double));
+	float* magnitude = (float*)arena_alloc(arena, max_frames*n_bins*sizeof(float));
+	float* frequency = (float*)arena_alloc(arena, max_frames*n_bins*sizeof(float));
+
+	if (!va || !frame || !spectrum || !in_fifo
+	    || !last_phase || !magnitude || !frequency) {
+		return NULL;
+	}
+	va->size = size;
+	va->hop = hop;
+	va->n_bins = n_bins;
+	va->max_frames = max_frames;
+	va->window = vp->window;
+	va->forward = vp->forward;
+	va->backward = vp->backward;
+	va->frame = frame;
+	va->spectrum = spectrum;
+	va->in_fifo = in_fifo;
+	va->last_phase = last_phase;
+	va->magnitude = magnitude;
+	va->frequency = frequency;
+
+	reset_vocoder_analysis(va);
+	return va;
+}
+
+static void
+vocoder_analyse_frame(VocoderAnalysis* va)
+{
+	const double expected = 2.0*VOCODER_PI*va->hop/va->size;
+	float* mag = va->magnitude + va->n_frames*va->n_bins;
+	float* freq = va->frequency + va->n_frames*va->n_bins;
+
+	for (uint32_t i=0; i<va->size; ++i) {
+		va->frame[i] = va->in_fifo[i] * va->window[i];
+	}
+	fftw_execute_dft_r2c(va->forward, va->frame, va->spectrum);
+
+	for (uint32_t k=0; k<va->n_bins; ++k) {
+		const double re = va->spectrum[k][0];
+		const double im = va->spectrum[k][1];
+		const double phase = atan2(im, re);
+
+		double delta = phase - va->last_phase[k] - k*expected;
+		va->last_phase[k] = phase;
+		delta -= 2.0*VOCODER_PI*rint(delta/(2.0*VOCODER_PI));
+
+		mag[k] = (float) sqrt(re*re + im*im);
+		freq[k] = (float) (k + delta*VOCODER_OVERSAMPLING/(2.0*VOCODER_PI));
+	}
+
+	++va->n_frames;
+}
+
+/* analyses the frames completed by the samples of in, their number is
+ * in va->n_frames afterwards */
+static void
+vocoder_analyse(VocoderAnalysis* va, const float* in, uint32_t n_samples)
+{
+	va->n_frames = 0;
+	while (n_samples > 0) {
+		uint32_t c = va->size - va->fill;
+		if (c > n_samples) {
+			c = n_samples;
+		}
+		memcpy(va->in_fifo + va->fill, in, c*sizeof(float));
+		va->fill += c;
+		in += c;
+		n_samples -= c;
+
+		if (va->fill == va->size) {
+			vocoder_analyse_frame(va);
+			memmove(va->in_fifo, va->in_fifo + va->hop, (va->size - va->hop)*sizeof(float));
+			va->fill = va->size - va->hop;
+		}
+	}
+}
+
+/* lets n_samples of silence pass without analysing them. The frames they
+ * complete are counted in va->n_frames, but hold nothing. */
+static void
+vocoder_skip(VocoderAnalysis* va, uint32_t n_samples)
+{
+	memset(va->in_fifo, 0, va->size*sizeof(float));
+	memset(va->last_phase, 0, va->n_bins*sizeof(double));
+	va->n_frames = 0;
+	va->fill += n_samples;
+	if (va->fill >= va->size) {
+		va->n_frames = (va->fill - va->size) / va->hop + 1;
+		va->fill -= va->n_frames * va->hop;
+	}
+}
+
+static void
+reset_vocoder_voice(const VocoderAnalysis* va, VocoderVoice* vv)
+{
+	memset(vv->sum_phase, 0, va->n_bins*sizeof(double));
+	memset(vv->out_accum, 0, va->size*sizeof(float));
+	vv->hop_pending = false;
+}
+
+/* the voice is carved from the arena, it needs no cleanup */
+static VocoderVoice*
+new_vocoder_voice(Arena* arena, const VocoderPlan* vp)
+{
+	const uint32_t size = vp->size;
+	const uint32_t n_bins = size/2 + 1;
+
+	VocoderVoice* vv = (VocoderVoice*)arena_alloc(arena, sizeof(VocoderVoice));
+	double* sum_phase = (double*)arena_alloc(arena, n_bins*sizeof(double));
+	float* syn_magnitude = (float*)arena_alloc(arena, n_bins*sizeof(float));
+	float* syn_frequency = (float*)arena_alloc(arena, n_bins*sizeof(float));
+	fftw_complex* spectrum = (fftw_complex*)arena_alloc(arena, n_bins*sizeof(fftw_complex));
+	double* frame = (double*)arena_alloc(arena, size*sizeof(double));
+	float* out_accum = (float*)arena_alloc(arena, size*sizeof(float));
+
+	if (!vv || !sum_phase || !syn_magnitude || !syn_frequency
+	    || !spectrum || !frame || !out_accum) {
+		return NULL;
+	}
+	vv->sum_phase = sum_phase;
+	vv->syn_magnitude = syn_magnitude;
+	vv->syn_frequency = syn_frequency;
+	vv->spectrum = spectrum;
+	vv->frame = frame;
+	vv->out_accum = out_accum;
+	return vv;
+}
+
+
+/* resynthesizes analysis frame f shifted by pitch_scale, returns the next
+ * va->hop output samples, valid until the next call */
+static const float*
+vocoder_synthesize(const VocoderAnalysis* va, VocoderVoice* vv, uint32_t f, double pitch_scale)
+{
+	const double expected = 2.0*VOCODER_PI*va->hop/va->size;
+	const float* mag = va->magnitude + f*va->n_bins;
+	const float* freq = va->frequency + f*va->n_bins;
+
+	if (vv->hop_pending) {
+		memmove(vv->out_accum, vv->out_accum + va->hop, (va->size - va->hop)*sizeof(float));
+		memset(vv->out_accum + va->size - va->hop, 0, va->hop*sizeof(float));
+	}
+
+	memset(vv->syn_magnitude, 0, va->n_bins*sizeof(float));
+	memset(vv->syn_frequency, 0, va->n_bins*sizeof(float));
+
+	for (uint32_t k=0; k<va->n_bins; ++k) {
+		const uint32_t index = (uint32_t) (k*pitch_scale + 0.5);
+		if (index >= va->n_bins) {
+			break;
+		}
+		vv->syn_magnitude[index] += mag[k];
+		vv->syn_frequency[index] = freq[k] * pitch_scale;
+	}
+
+	for (uint32_t k=0; k<va->n_bins; ++k) {
+		const double delta = (vv->syn_frequency[k] - k) * 2.0*VOCODER_PI/VOCODER_OVERSAMPLING;
+		double phase = vv->sum_phase[k] + k*expected + delta;
+		phase -= 2.0*VOCODER_PI*rint(phase/(2.0*VOCODER_PI));
+		vv->sum_phase[k] = phase;
+
+		vv->spectrum[k][0] = vv->syn_magnitude[k] * cos(phase);
+		vv->spectrum[k][1] = vv->syn_magnitude[k] * sin(phase);
+	}
+
+	fftw_execute_dft_c2r(va->backward, vv->spectrum, vv->frame);
+
+	// hann^2 windows with four times overlap add up to 1.5
+	const double scale = 1.0 / (va->size * 1.5);
+	for (uint32_t i=0; i<va->size; ++i) {
+		vv->out_accum[i] += (float) (va->window[i] * vv->frame[i] * scale);
+	}
+
+	vv->hop_pending = true;
+	return vv->out_accum;
+}
+
+#endif // HRM_PHASE_VOCODER_H
@@ -0,0 +1,163 @@
+/*
+    Copyright (C) 2016 Johannes Mueller <github@johannes-mueller.org>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    version 2 as published by the Free Software Foundation;
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * What all instances in the process share: one pool of worker threads,
+ * the read only tables and the FFT plans of the phase vocoder, one per
+ * frame size. The first instance sets the engine up and the last one
+ * takes it down again, so a session with many instances neither starts
+ * threads per instance, that would fight for the same cores, nor plans
+ * the same FFTs over and over.
+ *
+ * Acquiring and releasing takes a lock and may allocate, so it belongs to
+ * instantiate() and cleanup(). Everything in the engine stays untouched
+ * while any instance uses it, only the worker pool hands out one batch
+ * at a time, see worker_pool_run().
+ */
+
+#ifndef HRM_SHARED_ENGINE_H
+#define HRM_SHARED_ENGINE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "harmonigilo.h"
+#include "worker_pool.h"
+#include "phase_vocoder.h"
+#include "pan_law.h"
+#include "fractional_delay.h"
+
+// the frame sizes in use, one per sample rate, rarely more than one
+#define SHARED_VOCODER_PLANS 8
+
+typedef struct {
+	VocoderPlan plan;
+	uint32_t users;
+} SharedVocoderPlan;
+
+typedef struct {
+	uint32_t users;
+
+	WorkerPool* workers;
+
+	PanTable pan_table;
+	SincTable sinc_table;
+	ModTable mod_table;
+
+	SharedVocoderPlan vocoder[SHARED_VOCODER_PLANS];
+} SharedEngine;
+
+static SharedEngine* shared_engine = NULL;
+static pthread_mutex_t shared_engine_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the engine with one more user, NULL if it can't be set up */
+static SharedEngine*
+acquire_shared_engine(void)
+{
+	pthread_mutex_lock(&shared_engine_lock);
+	if (!shared_engine) {
+		shared_engine = (SharedEngine*)calloc(1, sizeof(SharedEngine));
+		if (shared_engine) {
+			init_pan_table(&shared_engine->pan_table);
+			init_sinc_table(&shared_engine->sinc_table);
+			init_mod_table(&shared_engine->mod_table);
+			// the calling thread processes jobs as well, so one core less
+			const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+			const long n_threads = n_cpus < MAX_CHAN_NUM ? n_cpus-1 : MAX_CHAN_NUM-1;
+			shared_engine->workers = new_worker_pool(n_threads > 0 ? (uint32_t)n_threads : 0);
+		}
+	}
+	SharedEngine* se = shared_engine;
+	if (se) {
+		++se->users;
+	}
+	pthread_mutex_unlock(&shared_engine_lock);
+	return se;
+}
+
+/* the last user takes the engine down */
+static void
+release_shared_engine(SharedEngine* se)
+{
+	if (!se) {
+		return;
+	}
+	pthread_mutex_lock(&shared_engine_lock);
+	if (--se->users == 0) {
+		delete_worker_pool(se->workers);
+		for (uint32_t i=0; i<SHARED_VOCODER_PLANS; ++i) {
+			if (se->vocoder[i].users) {
+				destroy_vocoder_plan(&se->vocoder[i].plan);
+			}
+		}
+		free(se);
+		shared_engine = NULL;
+	}
+	pthread_mutex_unlock(&shared_engine_lock);
+}
+
+/* the plan for frames of size samples, made by the first one to ask for
+ * it. The lock keeps FFTW's planner to one thread at a time. */
+static const VocoderPlan*
+acquire_vocoder_plan(SharedEngine* se, uint32_t size)
+{
+	SharedVocoderPlan* free_slot = NULL;
+	SharedVocoderPlan* svp = NULL;
+
+	pthread_mutex_lock(&shared_engine_lock);
+	for (uint32_t i=0; i<SHARED_VOCODER_PLANS && !svp; ++i) {
+		SharedVocoderPlan* p = &se->vocoder[i];
+		if (p->users && p->plan.size == size) {
+			svp = p;
+		} else if (!p->users && !free_slot) {
+			free_slot = p;
+		}
+	}
+	if (!svp && free_slot) {
+		if (init_vocoder_plan(&free_slot->plan, size)) {
+			svp = free_slot;
+		} else {
+			destroy_vocoder_plan(&free_slot->plan);
+		}
+	}
+	if (svp) {
+		++svp->users;
+	}
+	pthread_mutex_unlock(&shared_engine_lock);
+
+	return svp ? &svp->plan : NULL;
+}
+
+static void
+release_vocoder_plan(SharedEngine* se, const VocoderPlan* vp)
+{
+	if (!se || !vp) {
+		return;
+	}
+	pthread_mutex_lock(&shared_engine_lock);
+	for (uint32_t i=0; i<SHARED_VOCODER_PLANS; ++i) {
+		SharedVocoderPlan* p = &se->vocoder[i];
+		if (p->users && &p->plan == vp && --p->users == 0) {
+			destroy_vocoder_plan(&p->plan);
+		}
+	}
+	pthread_mutex_unlock(&shared_engine_lock);
+}
+
+#endif // HRM_SHARED_ENGINE_H
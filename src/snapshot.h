@@ -0,0 +1,108 @@
+/*
+    Copyright (C) 2016 Johannes Mueller <github@johannes-mueller.org>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    version 2 as published by the Free Software Foundation;
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * Two snapshots A and B of the voice setup, which the plugin can morph
+ * between, and which are saved as one blob in the plugin state.
+ *
+ * The state is saved and restored by the host while run() may be going
+ * on, so the snapshots are handed over through a sequence lock. The writer
+ * makes the sequence odd while it writes, the reader takes a copy and
+ * only accepts it if the sequence was even and hasn't changed meanwhile.
+ * Neither side waits for the other or allocates, a reader that has caught
+ * a write in progress just tries again later.
+ */
+
+#ifndef HRM_SNAPSHOT_H
+#define HRM_SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "harmonigilo.h"
+
+#define SNAPSHOT_STATE_VERSION 1
+
+enum {
+	SNAPSHOT_A = 0,
+	SNAPSHOT_B = 1,
+	N_SNAPSHOTS
+};
+
+/* the controls of a voice that are morphed */
+typedef struct {
+	float delay;
+	float pitch;
+	float pan;
+	float gain;
+} VoiceSetup;
+
+/* the blob in the plugin state, plain old data */
+typedef struct {
+	uint32_t version;
+	uint32_t n_voices;
+	// whether A and B have been stored yet
+	uint32_t stored[N_SNAPSHOTS];
+	VoiceSetup voice[N_SNAPSHOTS][MAX_CHAN_NUM];
+} SnapshotState;
+
+typedef struct {
+	uint32_t seq;
+	SnapshotState state;
+} SnapshotExchange;
+
+static inline void
+morph_voice_setup(const VoiceSetup* a, const VoiceSetup* b, float pos, VoiceSetup* vs)
+{
+	vs->delay = a->delay + pos * (b->delay - a->delay);
+	vs->pitch = a->pitch + pos * (b->pitch - a->pitch);
+	vs->pan = a->pan + pos * (b->pan - a->pan);
+	vs->gain = a->gain + pos * (b->gain - a->gain);
+}
+
+static void
+snapshot_exchange_write(SnapshotExchange* x, const SnapshotState* st)
+{
+	const uint32_t seq = __atomic_load_n(&x->seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&x->seq, seq+1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(&x->state, st, sizeof(SnapshotState));
+	__atomic_store_n(&x->seq, seq+2, __ATOMIC_RELEASE);
+}
+
+/* copies the state if it has been written since the sequence *seen,
+ * returns false if there is nothing new or a write is in progress. A
+ * write in progress may have left st partly overwritten, so st better
+ * isn't the state in use. */
+static bool
+snapshot_exchange_read(const SnapshotExchange* x, SnapshotState* st, uint32_t* seen)
+{
+	const uint32_t seq = __atomic_load_n(&x->seq, __ATOMIC_ACQUIRE);
+	if (seq == *seen || (seq & 1)) {
+		return false;
+	}
+	memcpy(st, &x->state, sizeof(SnapshotState));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&x->seq, __ATOMIC_RELAXED) != seq) {
+		return false;
+	}
+	*seen = seq;
+	return true;
+}
+
+#endif // HRM_SNAPSHOT_H
@@ -0,0 +1,294 @@
+/*
+    Copyright (C) 2016 Johannes Mueller <github@johannes-mueller.org>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    version 2 as published by the Free Software Foundation;
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/*
+ * A small pool of worker threads to spread independent jobs of one
+ * period across cores.
+ *
+ * The audio thread forks a batch with worker_pool_run(), helps processing
+ * it and returns when all jobs are done. Jobs are claimed through one
+ * atomic ticket which carries the batch generation in its upper 32 bits
+ * and the number of jobs of the batch next to the next job in the lower
+ * ones, so a worker waking up late can never steal a job of the next
+ * batch, not even while that one is being set up.
+ * Neither forking nor joining takes a lock, waking the workers is a
+ * semaphore post.
+ *
+ * The pool may be shared by several instances running on different
+ * threads. It takes one batch at a time, whoever finds it busy processes
+ * its batch on its own instead of waiting for the other one.
+ */
+
+#ifndef HRM_WORKER_POOL_H
+#define HRM_WORKER_POOL_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#include <mach/semaphore.h>
+#include <mach/task.h>
+#else
+#include <semaphore.h>
+#endif
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#define WORKER_RT_PRIORITY 60
+#define WORKER_SPIN_COUNT 1000
+// the job and the number of jobs share the lower half of the ticket
+#define WORKER_MAX_JOBS 0xffff
+
+typedef void (*WorkerJob)(void* arg, uint32_t job);
+
+typedef struct {
+#ifdef __APPLE__
+	semaphore_t sem;
+#else
+	sem_t sem;
+#endif
+} WorkerSem;
+
+typedef struct {
+	pthread_t* threads;
+	uint32_t n_threads;
+
+	WorkerSem wake;
+
+	WorkerJob job;
+	void* arg;
+
+	uint64_t ticket;
+	uint32_t generation;
+	uint32_t done;
+
+	bool busy;
+	bool running;
+} WorkerPool;
+
+static bool
+worker_sem_init(WorkerSem* s)
+{
+#ifdef __APPLE__
+	return semaphore_create(mach_task_self(), &s->sem, SYNC_POLICY_FIFO, 0) == KERN_SUCCESS;
+#else
+	return sem_init(&s->sem, 0, 0) == 0;
+#endif
+}
+
+static void
+worker_sem_destroy(WorkerSem* s)
+{
+#ifdef __APPLE__
+	semaphore_destroy(mach_task_self(), s->sem);
+#else
+	sem_destroy(&s->sem);
+#endif
+}
+
+static void
+worker_sem_post(WorkerSem* s)
+{
+#ifdef __APPLE__
+	semaphore_signal(s->sem);
+#else
+	sem_post(&s->sem);
+#endif
+}
+
+static void
+worker_sem_wait(WorkerSem* s)
+{
+#ifdef __APPLE__
+	semaphore_wait(s->sem);
+#else
+	while (sem_wait(&s->sem) != 0) {}
+#endif
+}
+
+static inline void
+worker_relax(void)
+{
+#ifdef __SSE2__
+	_mm_pause();
+#endif
+}
+
+/* claims and processes jobs of the current batch until none is left */
+static void
+worker_pool_process(WorkerPool* pool, uint32_t generation)
+{
+	for (;;) {
+		uint64_t t = __atomic_load_n(&pool->ticket, __ATOMIC_ACQUIRE);
+		if ((uint32_t)(t >> 32) != generation) {
+			return;
+		}
+		const uint32_t job = (uint32_t)t & WORKER_MAX_JOBS;
+		if (job >= ((uint32_t)t >> 16)) {
+			return;
+		}
+		if (!__atomic_compare_exchange_n(&pool->ticket, &t, t+1, false,
+						 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			continue;
+		}
+		pool->job(pool->arg, job);
+		__atomic_add_fetch(&pool->done, 1, __ATOMIC_RELEASE);
+	}
+}
+
+static void*
+worker_thread(void* arg)
+{
+	WorkerPool* pool = (WorkerPool*)arg;
+
+#ifdef __SSE__
+	// flush denormals to zero like the host does for its own audio thread
+	_mm_setcsr(_mm_getcsr() | 0x8040);
+#endif
+
+	for (;;) {
+		worker_sem_wait(&pool->wake);
+		if (!__atomic_load_n(&pool->running, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+		worker_pool_process(pool, __atomic_load_n(&pool->generation, __ATOMIC_ACQUIRE));
+	}
+	return NULL;
+}
+
+static void delete_worker_pool(WorkerPool* pool);
+
+static WorkerPool*
+new_worker_pool(uint32_t n_threads)
+{
+	if (n_threads == 0) {
+		return NULL;
+	}
+
+	WorkerPool* pool = (WorkerPool*)calloc(1, sizeof(WorkerPool));
+	if (!pool) {
+		return NULL;
+	}
+	pool->threads = (pthread_t*)calloc(n_threads, sizeof(pthread_t));
+	if (!pool->threads || !worker_sem_init(&pool->wake)) {
+		free(pool->threads);
+		free(pool);
+		return NULL;
+	}
+	pool->running = true;
+
+	for (uint32_t i=0; i<n_threads; ++i) {
+		pthread_attr_t attr;
+		struct sched_param param;
+		param.sched_priority = WORKER_RT_PRIORITY;
+
+		pthread_attr_init(&attr);
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &param);
+
+		int rv = pthread_create(&pool->threads[i], &attr, worker_thread, pool);
+		pthread_attr_destroy(&attr);
+		if (rv != 0) {
+			// no realtime privileges, try again with default scheduling
+			rv = pthread_create(&pool->threads[i], NULL, worker_thread, pool);
+		}
+		if (rv != 0) {
+			break;
+		}
+		pool->n_threads = i+1;
+	}
+
+	if (pool->n_threads == 0) {
+		delete_worker_pool(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+static void
+delete_worker_pool(WorkerPool* pool)
+{
+	if (!pool) {
+		return;
+	}
+	__atomic_store_n(&pool->running, false, __ATOMIC_RELEASE);
+	for (uint32_t i=0; i<pool->n_threads; ++i) {
+		worker_sem_post(&pool->wake);
+	}
+	for (uint32_t i=0; i<pool->n_threads; ++i) {
+		pthread_join(pool->threads[i], NULL);
+	}
+	worker_sem_destroy(&pool->wake);
+	free(pool->threads);
+	free(pool);
+}
+
+/* runs job(arg, 0) ... job(arg, n_jobs-1) spread across the workers and
+ * the calling thread, returns when all of them are finished. n_jobs must
+ * not exceed WORKER_MAX_JOBS. */
+static void
+worker_pool_run(WorkerPool* pool, WorkerJob job, void* arg, uint32_t n_jobs)
+{
+	if (n_jobs == 0) {
+		return;
+	}
+
+	bool idle = false;
+	if (!__atomic_compare_exchange_n(&pool->busy, &idle, true, false,
+					 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		for (uint32_t j=0; j<n_jobs; ++j) {
+			job(arg, j);
+		}
+		return;
+	}
+
+	pool->job = job;
+	pool->arg = arg;
+	__atomic_store_n(&pool->done, 0, __ATOMIC_RELAXED);
+
+	const uint32_t generation = pool->generation + 1;
+	__atomic_store_n(&pool->generation, generation, __ATOMIC_RELEASE);
+	__atomic_store_n(&pool->ticket, (uint64_t)generation << 32 | n_jobs << 16, __ATOMIC_RELEASE);
+
+	const uint32_t n_wake = n_jobs-1 < pool->n_threads ? n_jobs-1 : pool->n_threads;
+	for (uint32_t i=0; i<n_wake; ++i) {
+		worker_sem_post(&pool->wake);
+	}
+
+	worker_pool_process(pool, generation);
+
+	uint32_t spin = 0;
+	while (__atomic_load_n(&pool->done, __ATOMIC_ACQUIRE) < n_jobs) {
+		if (++spin < WORKER_SPIN_COUNT) {
+			worker_relax();
+		} else {
+			sched_yield();
+		}
+	}
+
+	__atomic_store_n(&pool->busy, false, __ATOMIC_RELEASE);
+}
+
+#endif // HRM_WORKER_POOL_H